@@ -2,6 +2,8 @@
 #include "InetAddress.h"
 #include "Logger.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -19,18 +21,31 @@ static int createNonBlocking() {
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr,
                    bool reuseport)
     : loop_(loop), acceptSocket_(createNonBlocking()),
-      acceptChannel_(loop_, acceptSocket_.fd()), listenning_(false) {
+      acceptChannel_(loop_, acceptSocket_.fd()), listenning_(false),
+      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)) {
     acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    // 多个socket监听同一个端口时由内核分发新连接
+    acceptSocket_.setReusePort(reuseport);
     acceptSocket_.bindAddress(listenAddr); // bind
     // TcpServer::start() Acceptor.listen 有新用户的连接，要执行一个回调(connfd
     // => channel=> subloop) baseLoop => acceptChannel_(listenfd) =>
     acceptChannel_.setReadCallBack(std::bind(&Acceptor::handleRead, this));
 }
 
+// 继承来的socket可能已经在listen，再调用一次listen只会更新backlog，
+// 全连接队列里已有的连接不会丢
+Acceptor::Acceptor(EventLoop *loop, int listenFd)
+    : loop_(loop), acceptSocket_(listenFd),
+      acceptChannel_(loop_, acceptSocket_.fd()), listenning_(false),
+      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)) {
+    ::fcntl(listenFd, F_SETFL, ::fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+    acceptChannel_.setReadCallBack(std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor() {
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    ::close(idleFd_);
 }
 
 void Acceptor::listen() {
@@ -40,21 +55,52 @@ void Acceptor::listen() {
 }
 
 // listenfd有事件发生了，就是有新用户连接了
+// 水平触发下每次只accept一个的话，连接风暴时每个连接都要一次epoll_wait，
+// 这里一直accept到EAGAIN，最多kMaxAcceptsPerEvent个
+// 连续分发给同一个subLoop的连接只会写一次eventfd（wakeup会合并），相当于批量转交
 void Acceptor::handleRead() {
-    InetAddress peerAddr;
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if (connfd >= 0) {
-        if (newConnectionCallBack_) {
-        newConnectionCallBack_(connfd, peerAddr); // 轮询找到subLoop，唤醒，分发当前的新客户端的Channel
-        } else {
-            ::close(connfd);
+    for (int i = 0; i < kMaxAcceptsPerEvent; ++i) {
+        InetAddress peerAddr;
+        int connfd = acceptSocket_.accept(&peerAddr);
+        if (connfd >= 0) {
+            if (newConnectionCallBack_) {
+                newConnectionCallBack_(connfd, peerAddr); // 轮询找到subLoop，唤醒，分发当前的新客户端的Channel
+            } else {
+                ::close(connfd);
+            }
+            continue;
+        }
+
+        int savedErrno = errno;
+        if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK) {
+            break;
         }
-    } else {
-        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__,
-                  errno);
-        if (errno == EMFILE) {
-            LOG_ERROR("%s:%s:%d sockfd reached limit! \n", __FILE__, __FUNCTION__,
-                      __LINE__);
+        if (savedErrno == EINTR || savedErrno == ECONNABORTED ||
+            savedErrno == EPROTO) {
+            // 对端在accept之前就断开了之类的，接着accept下一个
+            continue;
         }
+        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__,
+                  __LINE__, savedErrno);
+        if (savedErrno == EMFILE || savedErrno == ENFILE) {
+            LOG_ERROR("%s:%s:%d sockfd reached limit! \n", __FILE__,
+                      __FUNCTION__, __LINE__);
+            handleFdExhausted();
+        }
+        break;
+    }
+}
+
+// 不处理的话连接一直留在全连接队列里，listenfd一直可读，loop会空转占满CPU
+// 关掉预留的fd腾出一个位置，accept之后马上关闭，对端会收到FIN，再把预留fd打开
+void Acceptor::handleFdExhausted() {
+    if (idleFd_ < 0) {
+        return;
+    }
+    ::close(idleFd_);
+    idleFd_ = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    if (idleFd_ >= 0) {
+        ::close(idleFd_);
     }
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
 }
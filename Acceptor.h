@@ -13,6 +13,8 @@ public:
     using NewConnectionCallBack =
         std::function<void(int sockfd, const InetAddress &)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 接管一个已经bind好的监听socket（比如旧进程通过SCM_RIGHTS传过来的），析构时关闭
+    Acceptor(EventLoop *loop, int listenFd);
     ~Acceptor();
 
     void setNewConnectionCallback(const NewConnectionCallBack &cb) {
@@ -20,13 +22,21 @@ public:
     }
 
     bool listenning() const { return listenning_; }
+    int fd() const { return acceptSocket_.fd(); }
     void listen();
 
 private:
     void handleRead();
+    // 进程fd用完时，用预留的空闲fd接受并立即关闭一个连接，让listenfd不再可读
+    void handleFdExhausted();
+
+    // 一次可读事件最多accept的连接数，避免连接风暴时一直占着loop
+    static const int kMaxAcceptsPerEvent = 64;
+
     EventLoop *loop_; // Acceptor 用的就是用户定义的baseLoop，也称作mainLoop
     Socket acceptSocket_;
     Channel acceptChannel_;
     NewConnectionCallBack newConnectionCallBack_;
     bool listenning_;
+    int idleFd_; // 预留的空闲fd，指向/dev/null
 };
\ No newline at end of file
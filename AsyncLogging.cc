@@ -0,0 +1,255 @@
+#include "AsyncLogging.h"
+#include "LogFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+__thread AsyncLogging::ThreadBuffer *AsyncLogging::t_threadBuffer_ = nullptr;
+__thread uint64_t AsyncLogging::t_ownerId_ = 0;
+
+static std::atomic<uint64_t> s_nextId(1);
+
+struct AsyncLogging::ThreadBufferHolder {
+    ~ThreadBufferHolder() {
+        for (auto &entry : entries) {
+            std::unique_lock<std::mutex> lock(entry.second->mutex);
+            entry.second->retired = true;
+        }
+    }
+    // 键是AsyncLogging::id_，一个线程通常只用一两个实例，顺序查找即可
+    std::vector<std::pair<uint64_t, ThreadBufferPtr>> entries;
+};
+
+AsyncLogging::ThreadBufferHolder &AsyncLogging::threadBufferHolder() {
+    static thread_local ThreadBufferHolder holder;
+    return holder;
+}
+
+AsyncLogging::AsyncLogging(const std::string &basename, off_t rollSize,
+                           int flushInterval, size_t maxBufferedBytes)
+    : basename_(basename), rollSize_(rollSize), flushInterval_(flushInterval),
+      maxBuffers_(maxBufferedBytes / kLogBufferSize > 2
+                      ? maxBufferedBytes / kLogBufferSize
+                      : 2),
+      id_(s_nextId++), running_(false), dropped_(0),
+      thread_(std::bind(&AsyncLogging::threadFunc, this), "Logging"),
+      allocatedBuffers_(0), flushRequested_(0), flushCompleted_(0) {}
+
+AsyncLogging::~AsyncLogging() {
+    if (running_) {
+        stop();
+    }
+    // 还活着的线程仍然持有这些缓冲区，先把日志块还掉，线程下次查找时丢弃这一项
+    for (const ThreadBufferPtr &tb : threadBuffers_) {
+        std::unique_lock<std::mutex> lock(tb->mutex);
+        tb->current.reset();
+        tb->detached = true;
+    }
+}
+
+void AsyncLogging::start() {
+    running_ = true;
+    thread_.start();
+}
+
+void AsyncLogging::stop() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+// 第一次写日志的线程注册自己的缓冲区，之后只访问线程局部的指针
+// 同一个线程交替使用多个实例时，从holder里找回之前注册的缓冲区，不会重复注册
+AsyncLogging::ThreadBuffer *AsyncLogging::threadBuffer() {
+    if (t_ownerId_ == id_) {
+        return t_threadBuffer_;
+    }
+
+    ThreadBufferHolder &holder = threadBufferHolder();
+    holder.entries.erase(
+        std::remove_if(holder.entries.begin(), holder.entries.end(),
+                       [](const std::pair<uint64_t, ThreadBufferPtr> &entry) {
+                           return entry.second->detached.load();
+                       }),
+        holder.entries.end());
+
+    ThreadBufferPtr tb;
+    for (const auto &entry : holder.entries) {
+        if (entry.first == id_) {
+            tb = entry.second;
+            break;
+        }
+    }
+    if (!tb) {
+        tb.reset(new ThreadBuffer);
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            threadBuffers_.push_back(tb);
+        }
+        holder.entries.push_back(std::make_pair(id_, tb));
+    }
+    t_threadBuffer_ = tb.get();
+    t_ownerId_ = id_;
+    return t_threadBuffer_;
+}
+
+// 内存预算用完时，先把已经退出的线程手里的日志块收回来，不用等后台线程的下一轮
+// 调用者持有自己的ThreadBuffer::mutex，别的线程可能反过来等mutex_，所以只能try_lock
+void AsyncLogging::reclaimRetiredBuffers() {
+    for (const ThreadBufferPtr &tb : threadBuffers_) {
+        if (!tb->mutex.try_lock()) {
+            continue;
+        }
+        if (tb->retired && tb->current) {
+            if (tb->current->len > 0) {
+                fullBuffers_.push_back(std::move(tb->current));
+            } else {
+                freeBuffers_.push_back(std::move(tb->current));
+            }
+        }
+        tb->mutex.unlock();
+    }
+}
+
+AsyncLogging::BufferPtr AsyncLogging::acquireBuffer() {
+    BufferPtr buffer;
+    if (freeBuffers_.empty() && allocatedBuffers_ >= maxBuffers_) {
+        reclaimRetiredBuffers();
+    }
+    if (!freeBuffers_.empty()) {
+        buffer = std::move(freeBuffers_.back());
+        freeBuffers_.pop_back();
+    } else if (allocatedBuffers_ < maxBuffers_) {
+        buffer.reset(new LogBuffer);
+        ++allocatedBuffers_;
+    }
+    return buffer;
+}
+
+void AsyncLogging::append(const char *logline, size_t len) {
+    ThreadBuffer *tb = threadBuffer();
+    std::unique_lock<std::mutex> tbLock(tb->mutex);
+
+    if (tb->current && tb->current->avail() > len) {
+        // 绝大多数情况：直接拷贝到本线程的缓冲区
+        memcpy(tb->current->data + tb->current->len, logline, len);
+        tb->current->len += len;
+        return;
+    }
+
+    // 当前缓冲区写满了（或者还没有），交给后台线程并换一块新的
+    bool notify = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (tb->current) {
+            fullBuffers_.push_back(std::move(tb->current));
+            notify = true;
+        }
+        tb->current = acquireBuffer();
+        // acquireBuffer可能把已退出线程的日志块放进了fullBuffers_
+        notify = notify || !fullBuffers_.empty();
+    }
+    if (notify) {
+        cond_.notify_one();
+    }
+
+    if (tb->current && tb->current->avail() > len) {
+        memcpy(tb->current->data + tb->current->len, logline, len);
+        tb->current->len += len;
+    } else {
+        ++dropped_;
+    }
+}
+
+void AsyncLogging::flush() {
+    if (!running_) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t seq = ++flushRequested_;
+    cond_.notify_one();
+    while (running_ && flushCompleted_ < seq) {
+        flushCond_.wait(lock);
+    }
+}
+
+void AsyncLogging::threadFunc() {
+    LogFile output(basename_, rollSize_);
+    BufferVector buffersToWrite;
+    std::vector<ThreadBufferPtr> threadBuffers;
+    uint64_t reportedDropped = 0;
+
+    bool running = true;
+    while (running) {
+        uint64_t flushSeq = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::seconds(flushInterval_), [this] {
+                return !fullBuffers_.empty() ||
+                       flushRequested_ != flushCompleted_ || !running_;
+            });
+            running = running_;
+            buffersToWrite.swap(fullBuffers_);
+            threadBuffers = threadBuffers_;
+            flushSeq = flushRequested_;
+        }
+
+        // 把各个前端线程还没写满的缓冲区也收过来，保证日志最多延迟flushInterval秒
+        // 已经退出的线程的缓冲区连同空的日志块一起回收
+        std::vector<ThreadBuffer *> retired;
+        for (const ThreadBufferPtr &tb : threadBuffers) {
+            std::unique_lock<std::mutex> tbLock(tb->mutex);
+            if (tb->current && (tb->current->len > 0 || tb->retired)) {
+                buffersToWrite.push_back(std::move(tb->current));
+            }
+            if (tb->retired) {
+                retired.push_back(tb.get());
+            }
+        }
+
+        uint64_t dropped = dropped_;
+        if (dropped != reportedDropped) {
+            char buf[128];
+            int n = snprintf(buf, sizeof buf,
+                             "Dropped %lu log messages, total %lu\n",
+                             static_cast<unsigned long>(dropped - reportedDropped),
+                             static_cast<unsigned long>(dropped));
+            fputs(buf, stderr);
+            output.append(buf, n);
+            reportedDropped = dropped;
+        }
+
+        for (const BufferPtr &buffer : buffersToWrite) {
+            if (buffer->len > 0) {
+                output.append(buffer->data, buffer->len);
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (BufferPtr &buffer : buffersToWrite) {
+                buffer->len = 0;
+                freeBuffers_.push_back(std::move(buffer));
+            }
+            // 只删除上面已经收走日志块的，收集之后才退出的线程留到下一轮
+            threadBuffers_.erase(
+                std::remove_if(threadBuffers_.begin(), threadBuffers_.end(),
+                               [&retired](const ThreadBufferPtr &tb) {
+                                   return std::find(retired.begin(),
+                                                    retired.end(),
+                                                    tb.get()) != retired.end();
+                               }),
+                threadBuffers_.end());
+            flushCompleted_ = flushSeq;
+        }
+        buffersToWrite.clear();
+        threadBuffers.clear();
+        flushCond_.notify_all();
+    }
+    output.flush();
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Thread.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * 异步日志后端（双缓冲）
+ * 前端：每个写日志的线程有自己的当前缓冲区，写满之后交给后台线程，前端只做memcpy
+ * 后端：后台线程定期（或者有写满的缓冲区时）把所有缓冲区收集起来，
+ *       一次一块地write到LogFile，写完的缓冲区回收复用
+ * 所有缓冲区的总大小不超过maxBufferedBytes，超出后新的日志直接丢弃并计数
+ *
+ * 用法：
+ *   AsyncLogging log("server", 500 * 1024 * 1024);
+ *   log.start();
+ *   Logger::instance().setOutput(std::bind(&AsyncLogging::append, &log, _1, _2));
+ *   Logger::instance().setFlush(std::bind(&AsyncLogging::flush, &log));
+ */
+class AsyncLogging : noncopyable {
+public:
+    AsyncLogging(const std::string &basename, off_t rollSize,
+                 int flushInterval = 3,
+                 size_t maxBufferedBytes = 64 * 1024 * 1024);
+    ~AsyncLogging();
+
+    // 前端接口，任意线程调用
+    void append(const char *logline, size_t len);
+    // 阻塞直到调用之前的日志全部写入文件
+    void flush();
+
+    void start();
+    void stop();
+
+    // 因为内存预算用完而丢弃的日志条数
+    uint64_t droppedMessages() const { return dropped_; }
+
+private:
+    static const size_t kLogBufferSize = 256 * 1024;
+
+    // 固定大小的日志缓冲区
+    struct LogBuffer {
+        LogBuffer() : len(0) {}
+        size_t avail() const { return sizeof data - len; }
+        char data[kLogBufferSize];
+        size_t len;
+    };
+    using BufferPtr = std::unique_ptr<LogBuffer>;
+    using BufferVector = std::vector<BufferPtr>;
+
+    // 每个前端线程在每个AsyncLogging实例上私有的缓冲区，mutex只和后台线程竞争
+    struct ThreadBuffer {
+        ThreadBuffer() : retired(false), detached(false) {}
+        std::mutex mutex;
+        BufferPtr current;
+        bool retired;              // 所属线程已经退出，由后台线程回收，受mutex保护
+        std::atomic_bool detached; // 所属的AsyncLogging已经析构
+    };
+    using ThreadBufferPtr = std::shared_ptr<ThreadBuffer>;
+    // 线程局部，记录本线程在各个实例上的缓冲区，线程退出时把它们标记为retired
+    struct ThreadBufferHolder;
+    static ThreadBufferHolder &threadBufferHolder();
+
+    void threadFunc();
+    ThreadBuffer *threadBuffer();
+    // 从空闲池中取一块缓冲区，超出内存预算时返回nullptr，需持有mutex_
+    BufferPtr acquireBuffer();
+    // 收回已退出线程的缓冲区里的日志块，需持有mutex_
+    void reclaimRetiredBuffers();
+
+    const std::string basename_;
+    const off_t rollSize_;
+    const int flushInterval_;
+    const size_t maxBuffers_;
+    const uint64_t id_; // 区分不同的AsyncLogging实例，用于线程私有缓冲区的归属判断
+
+    std::atomic_bool running_;
+    std::atomic<uint64_t> dropped_;
+    Thread thread_;
+
+    std::mutex mutex_; // 保护下面的成员
+    std::condition_variable cond_;
+    std::condition_variable flushCond_;
+    BufferVector fullBuffers_;                  // 前端写满的缓冲区
+    BufferVector freeBuffers_;                  // 后台写完回收的缓冲区
+    std::vector<ThreadBufferPtr> threadBuffers_; // 所有前端线程的缓冲区
+    size_t allocatedBuffers_;
+    uint64_t flushRequested_;
+    uint64_t flushCompleted_;
+
+    static __thread ThreadBuffer *t_threadBuffer_;
+    static __thread uint64_t t_ownerId_;
+};
@@ -1,44 +1,389 @@
 #include "Buffer.h"
+#include "BufferPool.h"
 
 #include <errno.h>
+#include <string.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+Buffer::~Buffer() {
+    for (const Block &block : blocks_) {
+        releaseBlock(block);
+    }
+}
+
+void Buffer::swap(Buffer &rhs) {
+    buffer_.swap(rhs.buffer_);
+    std::swap(readIndex_, rhs.readIndex_);
+    std::swap(writeIndex_, rhs.writeIndex_);
+    std::swap(pool_, rhs.pool_);
+    blocks_.swap(rhs.blocks_);
+    std::swap(chainReadable_, rhs.chainReadable_);
+    std::swap(readSizeHint_, rhs.readSizeHint_);
+    std::swap(readShrinkCount_, rhs.readShrinkCount_);
+    std::swap(readSpillCount_, rhs.readSpillCount_);
+}
+
+void Buffer::setBlockPool(BufferPool *pool) {
+    if (pool == pool_) {
+        return;
+    }
+
+    // 先把已有数据取出来，切换存储方式之后再放回去
+    std::string data = retrieveeAllAsString();
+    for (const Block &block : blocks_) {
+        releaseBlock(block);
+    }
+    blocks_.clear();
+    chainReadable_ = 0;
+
+    pool_ = pool;
+    if (pool_) {
+        // 链式模式不再需要连续的vector
+        std::vector<char>().swap(buffer_);
+        readIndex_ = writeIndex_ = 0;
+    } else {
+        buffer_.assign(kCheapPreend + kInitialSize, 0);
+        readIndex_ = writeIndex_ = kCheapPreend;
+    }
+    append(data.data(), data.size());
+}
+
+size_t Buffer::capacity() const {
+    if (!pool_) {
+        return buffer_.capacity();
+    }
+    size_t total = 0;
+    for (const Block &block : blocks_) {
+        total += block.capacity;
+    }
+    return total;
+}
+
+void Buffer::shrink(size_t reserve) {
+    // 大流量过后的空闲连接，下一次读从初始大小重新开始
+    readSizeHint_ = kInitialSize;
+    readShrinkCount_ = 0;
+    readSpillCount_ = 0;
+
+    const size_t readable = readableBytes();
+    if (pool_) {
+        if (capacity() <= readable + pool_->blockSize()) {
+            return;
+        }
+        std::string data;
+        chainCopyOut(&data, readable);
+        retrieveAll();
+        chainAppend(data.data(), data.size());
+        return;
+    }
+
+    if (buffer_.capacity() <= kCheapPreend + readable + reserve) {
+        return;
+    }
+    std::vector<char> buf(kCheapPreend + readable + reserve);
+    std::copy(begin() + readIndex_, begin() + writeIndex_,
+              buf.begin() + kCheapPreend);
+    buffer_.swap(buf);
+    readIndex_ = kCheapPreend;
+    writeIndex_ = readIndex_ + readable;
+}
+
+void Buffer::releaseBlock(const Block &block) {
+    if (block.pooled) {
+        pool_->release(block.data);
+    } else {
+        delete[] block.data;
+    }
+}
+
+void Buffer::chainAddBlock(size_t len) {
+    Block block;
+    if (len <= pool_->blockSize()) {
+        block.data = pool_->acquire();
+        block.capacity = pool_->blockSize();
+        block.pooled = true;
+    } else {
+        // 比块还大的一次性写入，单独分配一块刚好够用的内存
+        block.data = new char[len];
+        block.capacity = len;
+        block.pooled = false;
+    }
+    block.readIndex = block.writeIndex = 0;
+    blocks_.push_back(block);
+}
+
+void Buffer::chainAppend(const char *data, size_t len) {
+    while (len > 0) {
+        if (blocks_.empty() ||
+            blocks_.back().writeIndex == blocks_.back().capacity) {
+            chainAddBlock(std::min(len, pool_->blockSize()));
+        }
+        Block &tail = blocks_.back();
+        size_t n = std::min(len, tail.capacity - tail.writeIndex);
+        memcpy(tail.data + tail.writeIndex, data, n);
+        tail.writeIndex += n;
+        chainReadable_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void Buffer::chainRetrieve(size_t len) {
+    len = std::min(len, chainReadable_);
+    chainReadable_ -= len;
+    while (len > 0) {
+        Block &front = blocks_.front();
+        size_t n = std::min(len, front.writeIndex - front.readIndex);
+        front.readIndex += n;
+        len -= n;
+        if (front.readIndex == front.writeIndex) {
+            // 读完的块立刻还给池子
+            releaseBlock(front);
+            blocks_.pop_front();
+        }
+    }
+    // 只剩一个空块时也还回去，空闲的连接不占用块
+    if (chainReadable_ == 0) {
+        for (const Block &block : blocks_) {
+            releaseBlock(block);
+        }
+        blocks_.clear();
+    }
+}
+
+void Buffer::chainCopyOut(std::string *out, size_t len) const {
+    len = std::min(len, chainReadable_);
+    out->reserve(len);
+    for (const Block &block : blocks_) {
+        if (len == 0) {
+            break;
+        }
+        size_t n = std::min(len, block.writeIndex - block.readIndex);
+        out->append(block.data + block.readIndex, n);
+        len -= n;
+    }
+}
+
+// 需要连续内存时，把跨多个块的数据合并成一块
+const char *Buffer::chainPeek() {
+    if (blocks_.empty()) {
+        return nullptr;
+    }
+    if (blocks_.front().writeIndex - blocks_.front().readIndex ==
+        chainReadable_) {
+        return blocks_.front().data + blocks_.front().readIndex;
+    }
+
+    Block merged;
+    if (chainReadable_ <= pool_->blockSize()) {
+        merged.data = pool_->acquire();
+        merged.capacity = pool_->blockSize();
+        merged.pooled = true;
+    } else {
+        merged.data = new char[chainReadable_];
+        merged.capacity = chainReadable_;
+        merged.pooled = false;
+    }
+    merged.readIndex = 0;
+    merged.writeIndex = 0;
+    for (const Block &block : blocks_) {
+        size_t n = block.writeIndex - block.readIndex;
+        memcpy(merged.data + merged.writeIndex, block.data + block.readIndex,
+               n);
+        merged.writeIndex += n;
+        releaseBlock(block);
+    }
+    blocks_.clear();
+    blocks_.push_back(merged);
+    return merged.data;
+}
+
+const size_t Buffer::kMinReadSizeHint;
+const size_t Buffer::kMaxReadSizeHint;
+
+namespace {
+// 每个线程一块的溢出缓冲区，readv时放在最后兜底
+// 只在线程创建时清零一次，之后每次读都直接复用，不再清零
+const size_t kExtraBufSize = 65536;
+__thread char t_extrabuf[kExtraBufSize];
+} // namespace
+
+// 根据最近一次读到的字节数调整下一次的预期读取大小
+// 读满了就翻倍，连续两次不到一半就减半，和netty的AdaptiveRecvByteBufAllocator类似
+void Buffer::adjustReadSizeHint(size_t n) {
+    if (n >= readSizeHint_) {
+        readSizeHint_ = std::min(readSizeHint_ * 2, kMaxReadSizeHint);
+        readShrinkCount_ = 0;
+    } else if (n < readSizeHint_ / 2) {
+        if (++readShrinkCount_ >= 2) {
+            readSizeHint_ = std::max(readSizeHint_ / 2, kMinReadSizeHint);
+            readShrinkCount_ = 0;
+        }
+    } else {
+        readShrinkCount_ = 0;
+    }
+}
+
 /**
  * 从fd上读取数据 poller工作在LT模式
  * Buffer缓冲区室友大小的，但是从fd上读数据的时候，却不知道tcp数据最终的大小
+ * 先读进Buffer现有的可写空间，超出的部分落到线程的溢出缓冲区里再append，
+ * 小消息的连接不会因为预期读取大小而把Buffer撑大
  */
-
 ssize_t Buffer::readFd(int fd, int *saveErrno) {
-    char extrabuf[65536] = {0}; // 栈上内存 64K
+    if (pool_) {
+        return chainReadFd(fd, saveErrno);
+    }
+
+    // 连续几次都读满溢出的连接，才把可写空间扩到预期大小，省掉之后每次的拷贝
+    if (readSpillCount_ >= kSpillsBeforeGrow &&
+        writableBytes() < readSizeHint_) {
+        ensureWritableBytes(readSizeHint_);
+    }
+
     struct iovec vec[2];
     const size_t writable =
         writableBytes(); // 这是Buffer底层缓冲区剩余的可写空间大小
     vec[0].iov_base = beginWrite();
     vec[0].iov_len = writable;
 
-    vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    vec[1].iov_base = t_extrabuf;
+    vec[1].iov_len = kExtraBufSize;
 
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    const int iovcnt = (writable < kExtraBufSize) ? 2 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0) {
         *saveErrno = errno;
-    } else if (n <= writable) { // buffer的可写缓冲区已经够存储读出来的数据
+    } else if (static_cast<size_t>(n) <=
+               writable) { // buffer的可写缓冲区已经够存储读出来的数据
         writeIndex_ += n;
+        readSpillCount_ = 0;
     } else { // extrabuf 里也写入了数据
         writeIndex_ = buffer_.size();
-        append(extrabuf,
+        append(t_extrabuf,
                n - writable); // writeIndex_开始写 n - writeable大小的数据
+        ++readSpillCount_;
+    }
+    if (n > 0) {
+        adjustReadSizeHint(n);
+    }
+
+    return n;
+}
+
+// 链式模式直接读进池子里的块，块数按预期读取大小决定，多出来的落到溢出缓冲区
+ssize_t Buffer::chainReadFd(int fd, int *saveErrno) {
+    const size_t blockSize = pool_->blockSize();
+    const int kMaxFresh = 16;
+
+    struct iovec vec[1 + kMaxFresh + 1];
+    char *fresh[kMaxFresh];
+    int iovcnt = 0;
+    const size_t writable = writableBytes();
+    if (writable > 0) {
+        vec[iovcnt].iov_base = beginWrite();
+        vec[iovcnt].iov_len = writable;
+        ++iovcnt;
+    }
+    int numFresh = 0;
+    if (readSizeHint_ > writable) {
+        numFresh = static_cast<int>(
+            (readSizeHint_ - writable + blockSize - 1) / blockSize);
+        numFresh = std::min(numFresh, kMaxFresh);
+    }
+    for (int i = 0; i < numFresh; ++i) {
+        fresh[i] = pool_->acquire();
+        vec[iovcnt].iov_base = fresh[i];
+        vec[iovcnt].iov_len = blockSize;
+        ++iovcnt;
     }
+    vec[iovcnt].iov_base = t_extrabuf;
+    vec[iovcnt].iov_len = kExtraBufSize;
+    ++iovcnt;
 
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0) {
+        *saveErrno = errno;
+    }
+
+    size_t remaining = n > 0 ? static_cast<size_t>(n) : 0;
+    chainReadable_ += remaining;
+    if (writable > 0) {
+        size_t used = std::min(remaining, writable);
+        blocks_.back().writeIndex += used;
+        remaining -= used;
+    }
+    for (int i = 0; i < numFresh; ++i) {
+        if (remaining > 0) {
+            Block block;
+            block.data = fresh[i];
+            block.capacity = blockSize;
+            block.readIndex = 0;
+            block.writeIndex = std::min(remaining, blockSize);
+            block.pooled = true;
+            blocks_.push_back(block);
+            remaining -= block.writeIndex;
+        } else {
+            pool_->release(fresh[i]); // 没有用到的块还回去
+        }
+    }
+    if (remaining > 0) {
+        // chainAppend自己会加上readable
+        chainReadable_ -= remaining;
+        chainAppend(t_extrabuf, remaining);
+    }
+    if (n > 0) {
+        adjustReadSizeHint(n);
+    }
     return n;
 }
 
 ssize_t Buffer::writeFd(int fd, int *saveErrno) {
+    if (pool_) {
+        return chainWriteFd(fd, saveErrno);
+    }
     ssize_t n = ::write(fd, peek(), readableBytes());
     if (n < 0) {
         *saveErrno = errno;
     }
     return n;
 }
+
+int Buffer::readableIovecs(struct iovec *vec, int maxIov) const {
+    int iovcnt = 0;
+    if (!pool_) {
+        if (readableBytes() > 0 && maxIov > 0) {
+            vec[0].iov_base = const_cast<char *>(begin() + readIndex_);
+            vec[0].iov_len = readableBytes();
+            iovcnt = 1;
+        }
+        return iovcnt;
+    }
+    for (const Block &block : blocks_) {
+        if (iovcnt == maxIov) {
+            break;
+        }
+        size_t len = block.writeIndex - block.readIndex;
+        if (len > 0) {
+            vec[iovcnt].iov_base = block.data + block.readIndex;
+            vec[iovcnt].iov_len = len;
+            ++iovcnt;
+        }
+    }
+    return iovcnt;
+}
+
+// 一次writev把所有块发出去，不需要先合并
+ssize_t Buffer::chainWriteFd(int fd, int *saveErrno) {
+    struct iovec vec[64];
+    int iovcnt = readableIovecs(vec, 64);
+    if (iovcnt == 0) {
+        return 0;
+    }
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0) {
+        *saveErrno = errno;
+    }
+    return n;
+}
@@ -2,38 +2,97 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <deque>
 #include <string>
+#include <sys/types.h>
 #include <vector>
 
-// 网络库底层的缓冲区定义
+class BufferPool;
+struct iovec;
+
+/**
+ * 网络库底层的缓冲区定义
+ * 默认是一块连续的std::vector<char>；
+ * 调用setBlockPool之后切换为链式模式：数据存放在一串从BufferPool取得的定长块中，
+ * append只会在尾部追加新块，不会拷贝已有数据，读完的块立刻还给池子，
+ * 空闲连接不占用任何块
+ *
+ * peek()在链式模式下需要连续内存时，会把数据合并到一块里（只在数据跨块时发生）
+ */
 class Buffer {
 public:
     static const size_t kCheapPreend = 8;
     static const size_t kInitialSize = 1024;
+    // readFd预期读取大小的范围
+    static const size_t kMinReadSizeHint = 512;
+    static const size_t kMaxReadSizeHint = 64 * 1024;
+    // 连续这么多次读满可写空间、溢出到线程缓冲区之后，才把Buffer扩到预期读取大小
+    static const int kSpillsBeforeGrow = 3;
 
     explicit Buffer(size_t initialSize = kInitialSize)
         : buffer_(kCheapPreend + initialSize), readIndex_(kCheapPreend),
-          writeIndex_(kCheapPreend) {}
+          writeIndex_(kCheapPreend), pool_(nullptr), chainReadable_(0),
+          readSizeHint_(kInitialSize), readShrinkCount_(0),
+          readSpillCount_(0) {}
+    ~Buffer();
 
-    size_t readableBytes() const { return writeIndex_ - readIndex_; }
+    // 链式模式下持有内存块，不能浅拷贝
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
 
-    size_t writableBytes() const { return buffer_.size() - writeIndex_; }
+    void swap(Buffer &rhs);
 
-    size_t prependableBytes() const { return readIndex_; }
+    // pool非空时切换为链式模式，为空时切换回连续模式，已有的数据会保留
+    // 只能在pool所属的loop线程调用
+    void setBlockPool(BufferPool *pool);
+    bool chained() const { return pool_ != nullptr; }
+
+    size_t readableBytes() const {
+        return pool_ ? chainReadable_ : writeIndex_ - readIndex_;
+    }
+
+    size_t writableBytes() const {
+        if (pool_) {
+            return blocks_.empty() ? 0
+                                   : blocks_.back().capacity -
+                                         blocks_.back().writeIndex;
+        }
+        return buffer_.size() - writeIndex_;
+    }
+
+    size_t prependableBytes() const {
+        if (pool_) {
+            return blocks_.empty() ? 0 : blocks_.front().readIndex;
+        }
+        return readIndex_;
+    }
 
     // 返回缓冲区中可读数据的起始地址
-    const char *peek() const { return begin() + readIndex_; }
+    const char *peek() const {
+        if (pool_) {
+            return const_cast<Buffer *>(this)->chainPeek();
+        }
+        return begin() + readIndex_;
+    }
 
     // onMessage string <- Buffer
     void retrieve(size_t len) {
-        if (len < readableBytes()) {
+        if (pool_) {
+            chainRetrieve(len);
+        } else if (len < readableBytes()) {
             readIndex_ += len; //  应用只读取了可读缓冲区的数据一部分
         } else {               // len = readableByte()
             retrieveAll();
         }
     }
 
-    void retrieveAll() { readIndex_ = writeIndex_ = kCheapPreend; }
+    void retrieveAll() {
+        if (pool_) {
+            chainRetrieve(chainReadable_);
+        } else {
+            readIndex_ = writeIndex_ = kCheapPreend;
+        }
+    }
 
     // 把onMessage函数上报的Buffer数据，转成string类型数据返回
     std::string retrieveeAllAsString() {
@@ -41,12 +100,25 @@ public:
     }
 
     std::string retrieveAsString(size_t len) {
-        std::string result(peek(), len);
+        std::string result;
+        if (pool_) {
+            // 逐块拷贝，不需要先把数据合并成连续的
+            chainCopyOut(&result, len);
+        } else {
+            result.assign(peek(), len);
+        }
         // 上面一句把缓冲区中可读的数据已经读取出俩，这里要对应对缓冲区进行复位操作
         retrieve(len);
         return result;
     }
 
+    // 缓冲区实际占用的内存大小
+    size_t capacity() const;
+
+    // 释放多余的内存，只保留可读数据加上reserve字节的可写空间
+    // 链式模式下读空的块本来就已经还给池子，这里只把超过块大小的独立分配换回池子里的块
+    void shrink(size_t reserve);
+
     void ensureWritableBytes(size_t len) {
         if (writableBytes() < len) {
             makeSpace(len); // 扩容
@@ -55,21 +127,49 @@ public:
 
     // 把[data,data + len] 内存上的数据，添加到缓冲区当中
     void append(const char *data, size_t len) {
+        if (pool_) {
+            chainAppend(data, len);
+            return;
+        }
         ensureWritableBytes(len);
         std::copy(data, data + len, beginWrite());
         writeIndex_ += len;
     }
 
-    char *beginWrite() { return begin() + writeIndex_; }
+    // 链式模式下是尾块的可写位置，需要先ensureWritableBytes
+    char *beginWrite() {
+        if (pool_) {
+            return blocks_.empty()
+                       ? nullptr
+                       : blocks_.back().data + blocks_.back().writeIndex;
+        }
+        return begin() + writeIndex_;
+    }
 
-    const char *beginWrite() const { return begin() + writeIndex_; }
+    const char *beginWrite() const {
+        return const_cast<Buffer *>(this)->beginWrite();
+    }
 
     // 从fd上读取数据
     ssize_t readFd(int fd, int* saveErrno);
+    // 根据最近几次读到的数据量调整的下一次预期读取大小
+    size_t readSizeHint() const { return readSizeHint_; }
 
     // 通过fd发送数据
     ssize_t writeFd(int fd,int* saveErrno);
+
+    // 把可读数据按内存段填进vec，最多maxIov段，返回填了几段，不会合并数据
+    int readableIovecs(struct iovec *vec, int maxIov) const;
 private:
+    // 链式模式中的一个内存块，pooled为false时是超过块大小的独立分配
+    struct Block {
+        char *data;
+        size_t capacity;
+        size_t readIndex;
+        size_t writeIndex;
+        bool pooled;
+    };
+
     char *begin() {
         // it.operator*().operator&()
         return &*buffer_.begin(); // 底层数组首元素的地址
@@ -81,6 +181,10 @@ private:
     }
 
     void makeSpace(size_t len) {
+        if (pool_) {
+            chainAddBlock(len);
+            return;
+        }
         if (writableBytes() + prependableBytes() < len + kCheapPreend) {
             buffer_.resize(writeIndex_ + len);
         } else {
@@ -92,7 +196,27 @@ private:
         }
     }
 
+    // 链式模式的实现
+    const char *chainPeek();
+    void chainRetrieve(size_t len);
+    void chainAppend(const char *data, size_t len);
+    void chainCopyOut(std::string *out, size_t len) const;
+    // 在尾部追加一个至少能写len字节的块
+    void chainAddBlock(size_t len);
+    void releaseBlock(const Block &block);
+    ssize_t chainReadFd(int fd, int *saveErrno);
+    ssize_t chainWriteFd(int fd, int *saveErrno);
+    void adjustReadSizeHint(size_t n);
+
     std::vector<char> buffer_;
     size_t readIndex_;
     size_t writeIndex_;
-};
\ No newline at end of file
+
+    BufferPool *pool_;
+    std::deque<Block> blocks_;
+    size_t chainReadable_;
+
+    size_t readSizeHint_;
+    int readShrinkCount_; // 连续读到不足预期一半的次数
+    int readSpillCount_;  // 连续溢出到t_extrabuf的次数
+};
@@ -0,0 +1,34 @@
+#include "BufferPool.h"
+#include "CurrentThread.h"
+
+#include <stdlib.h>
+
+BufferPool::BufferPool(size_t blockSize, size_t maxFreeBlocks)
+    : blockSize_(blockSize), maxFreeBlocks_(maxFreeBlocks),
+      ownerTid_(CurrentThread::tid()), blocksInUse_(0) {}
+
+BufferPool::~BufferPool() {
+    for (char *block : freeList_) {
+        ::free(block);
+    }
+}
+
+char *BufferPool::acquire() {
+    ++blocksInUse_;
+    if (!freeList_.empty()) {
+        char *block = freeList_.back();
+        freeList_.pop_back();
+        return block;
+    }
+    return static_cast<char *>(::malloc(blockSize_));
+}
+
+void BufferPool::release(char *block) {
+    --blocksInUse_;
+    if (CurrentThread::tid() == ownerTid_ &&
+        freeList_.size() < maxFreeBlocks_) {
+        freeList_.push_back(block);
+    } else {
+        ::free(block);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <cstddef>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * 每个EventLoop一个的定长内存块池，给链式Buffer使用
+ * 所有块大小相同（默认8KB），用完的块放回空闲链表复用，
+ * 空闲块超过maxFreeBlocks之后直接还给分配器，避免池子只涨不跌
+ *
+ * acquire只能在所属loop线程调用；release在其他线程调用时
+ * （比如TcpConnection最后在用户线程析构）直接free，不碰空闲链表
+ */
+class BufferPool : noncopyable {
+public:
+    static const size_t kDefaultBlockSize = 8 * 1024;
+    static const size_t kDefaultMaxFreeBlocks = 1024;
+
+    explicit BufferPool(size_t blockSize = kDefaultBlockSize,
+                        size_t maxFreeBlocks = kDefaultMaxFreeBlocks);
+    ~BufferPool();
+
+    char *acquire();
+    void release(char *block);
+
+    size_t blockSize() const { return blockSize_; }
+    // 正在被Buffer使用的块数
+    size_t blocksInUse() const { return blocksInUse_; }
+    // 空闲链表中缓存的块数
+    size_t freeBlocks() const { return freeList_.size(); }
+
+private:
+    const size_t blockSize_;
+    const size_t maxFreeBlocks_;
+    const pid_t ownerTid_;
+    std::vector<char *> freeList_;
+    std::atomic<size_t> blocksInUse_;
+};
@@ -17,3 +17,5 @@ using MessageCallback =
 
 using HighWaterMarkCallback =
     std::function<void(const TcpConnectionPtr &, size_t)>;
+
+using TimerCallback = std::function<void()>;
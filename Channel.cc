@@ -7,9 +7,11 @@
 const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::kWriteEvent = EPOLLOUT;
+const int Channel::kEdgeTriggeredEvent = EPOLLET;
 
 Channel::Channel(EventLoop *loop, int fd)
-    : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), tied_(false) {}
+    : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1),
+      edgeTriggered_(false), tied_(false) {}
 
 Channel::~Channel() {}
 
@@ -49,7 +51,7 @@ void Channel::handleEvent(Timestamp recieveTime) {
 
 // 根据poller通知的Channel发生的具体事件，由Channel负责调用对应的回调事件
 void Channel::handleEventWithGuard(Timestamp receiveTime) {
-    LOG_INFO("channel handleEvent revents:%d\n", revents_);
+    LOG_TRACE("channel handleEvent revents:%d\n", revents_);
 
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)) {
         if (closeCallback_) {
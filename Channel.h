@@ -39,7 +39,13 @@ public:
     void tie(const std::shared_ptr<void>&);
 
     int fd()const {return fd_;}
-    int events()const {return events_;}
+    // 边沿触发模式下，注册给poller的事件会带上EPOLLET
+    int events() const {
+        return (edgeTriggered_ && events_ != kNoneEvent)
+                   ? events_ | kEdgeTriggeredEvent
+                   : events_;
+    }
+    int revents() const { return revents_; }
     void set_revents(int revt){revents_ = revt;}
 
     // 设置fd相应的事件状态
@@ -48,6 +54,13 @@ public:
     void enableWriting() { events_ |= kWriteEvent; update(); }
     void disableWriting() {events_ &= ~kWriteEvent; update();}
     void disableAll() { events_ = kNoneEvent; update();}
+    // 同时关注读写事件，只调用一次epoll_ctl
+    void enableAll() { events_ |= kReadEvent | kWriteEvent; update(); }
+
+    // 边沿触发模式（EPOLLET），需要在第一次enable之前设置
+    // 使用者必须在回调中一直读/写到EAGAIN
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    bool edgeTriggered() const { return edgeTriggered_; }
 
     bool isNoneEvent() const{return events_ == kNoneEvent;}
     bool isWriting() const {return events_ & kWriteEvent;}
@@ -69,12 +82,14 @@ private:
     static const int kNoneEvent;
     static const int kWriteEvent;
     static const int kReadEvent;
+    static const int kEdgeTriggeredEvent;
 
     EventLoop *loop_; // 事件循环
     const int fd_;    //  poller监听的对象
     int events_;       // 注册fd感兴趣的事件
     int revents_;      // poller返回的具体发生的事件
     int index_;
+    bool edgeTriggered_;
 
     // 用于进行回调监听，例如连接断开时回调被触发，但对象可能已经销毁，通过lock检测
     std::weak_ptr<void> tie_;
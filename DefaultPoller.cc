@@ -1,13 +1,40 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "PollPoller.h"
 
 #include <stdlib.h>
 
 Poller* Poller::newDefaultPoller(EventLoop * loop){
+    if (::getenv("MUDUO_USE_IO_URING")) {
+        return newPoller(loop, kIoUringPoller);
+    }
     if(::getenv("MUDUO_USE_POLL")){
-        // TODO 生成POLLPOLL的实例
-        return nullptr;
+        return newPoller(loop, kPollPoller);
     }else{
+        return newPoller(loop, kEPollPoller);
+    }
+}
+
+Poller *Poller::newPoller(EventLoop *loop, PollerBackend backend) {
+    switch (backend) {
+    case kPollPoller:
+        return new PollPoller(loop);
+    case kIoUringPoller: {
+        IoUringPoller *poller = new IoUringPoller(loop);
+        if (poller->valid()) {
+            return poller;
+        }
+        // 内核不支持io_uring（或者被seccomp禁用）时回退到epoll
+        LOG_ERROR("io_uring is not available, fall back to epoll \n");
+        delete poller;
+        return new EPollPoller(loop);
+    }
+    case kEPollPoller:
         return new EPollPoller(loop);
+    case kDefaultPoller:
+    default:
+        return newDefaultPoller(loop);
     }
-}
\ No newline at end of file
+}
@@ -24,8 +24,8 @@ EPollPoller::EPollPoller(EventLoop *loop)
 EPollPoller::~EPollPoller() { ::close(epollfd_); }
 
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
-    // 并发环境下请求数量脚都，该函数被频繁调用，实际使用LOG_DEBUG较好
-    LOG_INFO("func=%s => fd total count:%d\n", __FUNCTION__, channels_.size());
+    // 每轮循环都会调用，使用TRACE，release构建中不会编译进来
+    LOG_TRACE("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels());
 
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(),
                                  static_cast<int>(events_.size()), timeoutMs);
@@ -34,13 +34,13 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
     Timestamp now(Timestamp::now());
 
     if (numEvents > 0) {
-        LOG_INFO("%d events happened \n ", numEvents);
+        LOG_TRACE("%d events happened \n", numEvents);
         fillActiceChannels(numEvents, activeChannels);
         if (numEvents == events_.size()) {
             events_.resize(events_.size() * 2);
         }
     } else if (numEvents == 0) {
-        LOG_DEBUG("%s timeout! \n", __FUNCTION__);
+        LOG_TRACE("%s timeout! \n", __FUNCTION__);
     } else {
         if (saveErrno != EINTR) {
             errno = saveErrno;
@@ -62,13 +62,12 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
  */
 void EPollPoller::updateChannel(Channel *channel) {
     const int index = channel->index();
-    LOG_INFO("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__,
+    LOG_TRACE("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__,
              channel->fd(), channel->events(), index);
 
     if (index == kNew || index == kDeleted) {
         if (index == kNew) {
-            int fd = channel->fd();
-            channels_[fd] = channel;
+            addChannel(channel);
         }
 
         channel->set_index(kAdded);
@@ -86,10 +85,9 @@ void EPollPoller::updateChannel(Channel *channel) {
 
 // 从poller中删除Channel
 void EPollPoller::removeChannel(Channel *channel) {
-    int fd = channel->fd();
-    channels_.erase(fd);
+    eraseChannel(channel);
 
-    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+    LOG_TRACE("func=%s => fd=%d\n", __FUNCTION__, channel->fd());
 
     int index = channel->index();
     if (index == kAdded) {
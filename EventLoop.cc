@@ -2,7 +2,11 @@
 #include "Channel.h"
 #include "Logger.h"
 #include "Poller.h"
+#include "TimerQueue.h"
+#include "TimingWheel.h"
+#include "BufferPool.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include <memory>
@@ -24,10 +28,17 @@ int createEventFd() {
     return evtfd;
 }
 // 主线程是可以拿到子线程的loop的，进而进行跨线程的调用
-EventLoop::EventLoop()
+EventLoop::EventLoop(PollerBackend backend)
     : looping_(false), quit_(false), callingPendingFunctors_(false),
-      threadId_(CurrentThread::tid()), poller_(Poller::newDefaultPoller(this)),
-      wakeupFd_(createEventFd()), wakeupChannel_(new Channel(this, wakeupFd_)) {
+      eventHandling_(false), threadId_(CurrentThread::tid()),
+      poller_(Poller::newPoller(this, backend)),
+      timerQueue_(new TimerQueue(this)),
+      wakeupFd_(createEventFd()), wakeupChannel_(new Channel(this, wakeupFd_)),
+      wakeupPending_(false), wakeupsIssued_(0), wakeupsSuppressed_(0),
+      bufferedBytes_(0), bufferMemoryBytes_(0), connectionCount_(0),
+      busyTimeUs_(0), recentBusyPermille_(0), polling_(false),
+      loadWindowStartUs_(Timestamp::now().microSecondsSinceEpoch()),
+      windowBusyUs_(0) {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     if (t_loopInThisThread) {
         LOG_FATAL("Another EventLoop %p exists in this thread %d \n",
@@ -59,11 +70,18 @@ void EventLoop::loop() {
     while (!quit_) {
         activeChannels_.clear();
         // 监听两类fd 一种是client的fd 一种是wakeupfd
+        polling_.store(true, std::memory_order_relaxed);
         pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        polling_.store(false, std::memory_order_relaxed);
+        eventHandling_ = true;
         for (Channel *channel : activeChannels_) {
             // Poller监听哪些channel发生事件了，然后上报给EventLoop，通知channel处理相应的事件
-            channel->handleEvent(pollReturnTime_);
+            // 本轮前面的回调里已经remove的channel置成了nullptr
+            if (channel != nullptr) {
+                channel->handleEvent(pollReturnTime_);
+            }
         }
+        eventHandling_ = false;
         // 执行当前EventLoop事件循环需要处理的回调操作
         /**
          * IO线程 mainLoop accept fd <= channel 分发给 subLoop
@@ -71,6 +89,9 @@ void EventLoop::loop() {
          * wakeup subloop后，执行之前mainLoop注册的cb操作
          */
         doPendingFunctors();
+        // 事件处理和回调里产生的输出统一在这里写出去
+        doAfterDispatchFunctors();
+        updateLoadStats(Timestamp::now());
     }
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
@@ -101,26 +122,31 @@ void EventLoop::runInLoop(Functor cb) {
     {
         cb();
     } else { // 在非当前loop线程中执行cb，就需要唤醒loop所在线程执行cb
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 // 把cb放入队列当中，唤醒loop所在的线程执行cb
 void EventLoop::queueInLoop(Functor cb) {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
-    }
+    pendingFunctors_.push(std::move(cb));
 
     // 唤醒相应的需要执行上面的回调操作的loop线程了
-    // callingPendingFcnctors_的意思是当前loop正在执行回调，但是loop又有了新的回调，
-    if (!isInLoopThread() || callingPendingFcnctors_) {
+    // callingPendingFunctors_的意思是当前loop正在执行回调，但是loop又有了新的回调，
+    if (!isInLoopThread() || callingPendingFunctors_) {
         wakeup(); // 唤醒loop所在线程
     }
 }
 
 // 用来唤醒loop所在的线程的，向wakeupFd——写一个数据
 // wakeup Channel发生了读事件
+// 只有wakeupPending_从false变为true的那一次才真正写eventfd，
+// 一批跨线程的queueInLoop只需要一次系统调用
 void EventLoop::wakeup() {
+    if (wakeupPending_.exchange(true, std::memory_order_acq_rel)) {
+        ++wakeupsSuppressed_;
+        return;
+    }
+    ++wakeupsIssued_;
+
     uint64_t one = 1;
     ssize_t n = write(wakeupFd_, &one, sizeof one);
     if (n != sizeof one) {
@@ -128,12 +154,48 @@ void EventLoop::wakeup() {
     }
 }
 
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb) {
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb) {
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb) {
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId) { timerQueue_->cancel(timerId); }
+
+TimingWheel *EventLoop::timingWheel() {
+    if (!timingWheel_) {
+        timingWheel_.reset(new TimingWheel(this));
+    }
+    return timingWheel_.get();
+}
+
+BufferPool *EventLoop::bufferPool() {
+    if (!bufferPool_) {
+        bufferPool_.reset(new BufferPool());
+    }
+    return bufferPool_.get();
+}
+
 void EventLoop::updateChannel(Channel *channel) {
     poller_->updateChannel(channel);
 }
 
+// 回调里可能析构同一轮里还没处理的channel（比如drain在定时器回调里关掉Acceptor），
+// 把它从activeChannels_里去掉，避免之后再调用已经析构的channel
 void EventLoop::removeChannel(Channel *channel) {
     poller_->removeChannel(channel);
+    if (eventHandling_) {
+        std::replace(activeChannels_.begin(), activeChannels_.end(), channel,
+                     static_cast<Channel *>(nullptr));
+    }
 }
 
 bool EventLoop::hasChannel(Channel *channel) {
@@ -148,20 +210,69 @@ void EventLoop::handleRead() {
     }
 }
 
-// 此处由于可能有多个其他线程调用，导致访问pendingFunctors可能会阻塞
-// 因此通过临时变量快速跳过阻塞部分，大大提高了并发效率
+// pendingFunctors_是无锁队列，生产者线程入队时不会和这里互相阻塞
+// 每次只执行进入时已经入队的回调，执行过程中新入队的回调留到下一轮
 void EventLoop::doPendingFunctors() {
-    std::vector<Functor> functors;
-    callingPendingFcnctors_ = true;
+    callingPendingFunctors_ = true;
+    // 必须在取回调之前清除标志：在此之后入队的回调会重新写eventfd，
+    // 在此之前被合并掉的回调一定能被下面的drain看到
+    wakeupPending_.exchange(false, std::memory_order_acq_rel);
 
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_);
+    pendingFunctors_.drain([](const Functor &functor) { functor(); });
+
+    callingPendingFunctors_ = false;
+}
+
+void EventLoop::updateLoadStats(Timestamp now) {
+    const int64_t nowUs = now.microSecondsSinceEpoch();
+    const int64_t busy = nowUs - pollReturnTime_.microSecondsSinceEpoch();
+    busyTimeUs_.store(busyTimeUs_.load(std::memory_order_relaxed) + busy,
+                      std::memory_order_relaxed);
+    windowBusyUs_ += busy;
+
+    const int64_t windowStart =
+        loadWindowStartUs_.load(std::memory_order_relaxed);
+    const int64_t elapsed = nowUs - windowStart;
+    if (elapsed >= kLoadWindowUs) {
+        recentBusyPermille_.store(
+            static_cast<int>(std::min<int64_t>(windowBusyUs_ * 1000 / elapsed,
+                                               1000)),
+            std::memory_order_relaxed);
+        loadWindowStartUs_.store(nowUs, std::memory_order_relaxed);
+        windowBusyUs_ = 0;
     }
+}
 
-    for (const Functor &functor : functors) {
-        functor();
+// 空闲的loop一直阻塞在poll里，不会更新统计，超过一个窗口没有更新时按空闲处理
+int EventLoop::recentBusyPermille() const {
+    if (polling_.load(std::memory_order_relaxed)) {
+        int64_t elapsed = Timestamp::now().microSecondsSinceEpoch() -
+                          loadWindowStartUs_.load(std::memory_order_relaxed);
+        if (elapsed >= 2 * kLoadWindowUs) {
+            return 0;
+        }
     }
+    return recentBusyPermille_.load(std::memory_order_relaxed);
+}
+
+void EventLoop::runAfterDispatch(Functor cb) {
+    afterDispatchFunctors_.push_back(std::move(cb));
+}
 
-    callingPendingFcnctors_ = false;
+// 回调里又登记的回调在同一轮里继续执行
+// 这里queueInLoop的回调要等下一轮，所以也按执行回调处理，保证会写eventfd唤醒
+void EventLoop::doAfterDispatchFunctors() {
+    if (afterDispatchFunctors_.empty()) {
+        return;
+    }
+    callingPendingFunctors_ = true;
+    std::vector<Functor> functors;
+    while (!afterDispatchFunctors_.empty()) {
+        functors.swap(afterDispatchFunctors_);
+        for (const Functor &functor : functors) {
+            functor();
+        }
+        functors.clear();
+    }
+    callingPendingFunctors_ = false;
 }
@@ -3,21 +3,27 @@
 #include <atomic>
 #include <functional>
 #include <memory>
-#include <mutex>
 #include <vector>
 
+#include "Callbacks.h"
 #include "CurrentThread.h"
+#include "MpscQueue.h"
+#include "Poller.h"
+#include "TimerId.h"
 #include "Timestamp.h"
 #include "noncopyable.h"
 
 class Channel;
-class Poller;
+class TimerQueue;
+class TimingWheel;
+class BufferPool;
 
 // 事件循环类 主要包含两个大模块 Channel Poller（epoll的抽象）
 class EventLoop {
 public:
     using Functor = std::function<void()>;
-    EventLoop();
+    // backend指定这个loop使用的IO复用实现，默认由环境变量决定
+    explicit EventLoop(PollerBackend backend = kDefaultPoller);
     ~EventLoop();
 
     // 开启事件循环
@@ -31,14 +37,64 @@ public:
     void runInLoop(Functor cb);
     // 把cb放入队列中，唤醒loop所在的线程，执行cb
     void queueInLoop(Functor cb);
+    // 本轮事件和回调都处理完之后、下一次poll之前执行cb，只能在loop所在线程调用
+    // TcpConnection用它把一轮里多次send合并成一次写
+    void runAfterDispatch(Functor cb);
+
+    // 定时器，线程安全，回调在loop所在线程执行
+    // 在time时刻执行cb
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    // delay秒之后执行cb
+    TimerId runAfter(double delay, TimerCallback cb);
+    // 每隔interval秒执行一次cb
+    TimerId runEvery(double interval, TimerCallback cb);
+    // 取消定时器
+    void cancel(TimerId timerId);
+
+    // 空闲连接检测用的时间轮，第一次使用时创建，只能在loop所在线程调用
+    TimingWheel *timingWheel();
+
+    // 链式Buffer使用的内存块池，第一次使用时创建，只能在loop所在线程调用
+    BufferPool *bufferPool();
+
+    // 这个loop上所有连接的输入输出缓冲区里待处理的字节数 / 缓冲区占用的内存
+    // 由TcpConnection在loop线程里更新，其他线程可以随时读取
+    int64_t bufferedBytes() const { return bufferedBytes_; }
+    int64_t bufferMemoryBytes() const { return bufferMemoryBytes_; }
+    // 只有loop线程会修改，不需要原子的读改写
+    void addBufferStats(int64_t bytesDelta, int64_t memoryDelta) {
+        bufferedBytes_.store(
+            bufferedBytes_.load(std::memory_order_relaxed) + bytesDelta,
+            std::memory_order_relaxed);
+        bufferMemoryBytes_.store(
+            bufferMemoryBytes_.load(std::memory_order_relaxed) + memoryDelta,
+            std::memory_order_relaxed);
+    }
+
+    // 负载统计，由loop线程更新，其他线程（比如分发新连接的baseLoop）可以随时读取
+    // 分配到这个loop上还没有销毁的连接数，TcpConnection构造时加一、connectDestoryed时减一
+    int connectionCount() const { return connectionCount_; }
+    void addConnectionCount(int delta) { connectionCount_ += delta; }
+    // 从poll返回到处理完本轮事件和回调累计的时间（微秒）
+    int64_t busyTimeUs() const { return busyTimeUs_; }
+    // 最近一个统计窗口里处理事件的时间占比，千分比
+    int recentBusyPermille() const;
 
     // 用来唤醒loop所在的线程
+    // loop还没处理上一次唤醒之前，后续的wakeup会被合并，不再重复写eventfd
     void wakeup();
 
+    // 实际写eventfd的次数 / 被合并掉的次数
+    uint64_t wakeupsIssued() const { return wakeupsIssued_; }
+    uint64_t wakeupsSuppressed() const { return wakeupsSuppressed_; }
+
     // EventLoop的方法=>Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *Channel);
+    bool supportsEdgeTriggered() const {
+        return poller_->supportsEdgeTriggered();
+    }
 
     // 判断EventLoop对象是否在自己的线程里面
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
@@ -48,6 +104,12 @@ private:
     void handleRead();
     // 执行回调 
     void doPendingFunctors();
+    // 执行runAfterDispatch登记的回调
+    void doAfterDispatchFunctors();
+    // 本轮处理结束，累加忙碌时间，统计窗口结束时更新recentBusyPermille_
+    void updateLoadStats(Timestamp now);
+
+    static const int64_t kLoadWindowUs = 100 * 1000; // 负载统计窗口100ms
 
     using ChannelList = std::vector<Channel *>;
 
@@ -55,20 +117,38 @@ private:
     std::atomic_bool quit_;    // 标志退出loop循环
     std::atomic_bool
         callingPendingFunctors_; // 标志当前loop是否有需要执行的回调函数
+    bool eventHandling_;         // 正在处理activeChannels_，只有loop线程访问
     const pid_t threadId_;       // 记录当前loop所在线程id
     Timestamp pollReturnTime_;   // poller返回发生事件的channels的时间点
     std::unique_ptr<Poller> poller_;
+    std::unique_ptr<TimerQueue> timerQueue_;
+    // 构造时向timerQueue_注册tick定时器，所以声明在它后面：先于timerQueue_析构，
+    // 析构时不cancel，tick定时器随timerQueue_一起释放，不会再触发
+    std::unique_ptr<TimingWheel> timingWheel_;
+    std::unique_ptr<BufferPool> bufferPool_;
 
     // 主要作用，当maniLoop获取一个新用户的channel，
     // 通过轮询算法选择一个subLoop，通过该成员通知唤醒subloop处理channel
     // 使用eventfd()创建，Linux独有的一种线程间通信机制，效率较高
     int wakeupFd_;
     std::unique_ptr<Channel> wakeupChannel_;
+    // 已经写过eventfd但loop还没有开始处理回调，由生产者置位，doPendingFunctors清除
+    std::atomic_bool wakeupPending_;
+    std::atomic<uint64_t> wakeupsIssued_;
+    std::atomic<uint64_t> wakeupsSuppressed_;
+    std::atomic<int64_t> bufferedBytes_;
+    std::atomic<int64_t> bufferMemoryBytes_;
+    std::atomic_int connectionCount_;
+    std::atomic<int64_t> busyTimeUs_;
+    std::atomic_int recentBusyPermille_;
+    std::atomic_bool polling_;          // 正阻塞在poll里
+    std::atomic<int64_t> loadWindowStartUs_; // 当前统计窗口的开始时间
+    int64_t windowBusyUs_;              // 当前统计窗口里的忙碌时间
 
     ChannelList activeChannels_;
 
-    std::atomic_bool
-        callingPendingFcnctors_; // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_; // 存储loop需要执行的所有的回调操作
-    std::mutex mutex_; // 互斥锁用来保护上面vector容器的线程安全操作
+    // 存储loop需要执行的所有的回调操作，其他线程无锁入队，loop线程批量取出
+    MpscQueue<Functor> pendingFunctors_;
+    // 本轮结束前要执行的回调，只有loop线程访问
+    std::vector<Functor> afterDispatchFunctors_;
 };
\ No newline at end of file
@@ -2,10 +2,11 @@
 #include "EventLoop.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallBack &cb,
-                                 const std::string &name)
+                                 const std::string &name,
+                                 PollerBackend backend)
     : loop_(nullptr), existing_(false),
       thread_(std::bind(&EventLoopThread::threadFunc, this), name), mutex_(),
-      cond_(), callback_(cb) {}
+      cond_(), callback_(cb), backend_(backend) {}
 
 EventLoopThread::~EventLoopThread() {
     existing_ = true;
@@ -30,7 +31,7 @@ EventLoop *EventLoopThread::startLoop() {
 }
 // 下面这个方法，是在单独的新线程里面运行的
 void EventLoopThread::threadFunc() {
-    EventLoop loop; // 创建一个独立的EventLoop，和上面的线程是一一对应的
+    EventLoop loop(backend_); // 创建一个独立的EventLoop，和上面的线程是一一对应的
     if (callback_) {
         callback_(&loop);
     }
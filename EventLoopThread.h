@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Poller.h"
 #include "Thread.h"
 #include "noncopyable.h"
 
@@ -14,7 +15,8 @@ public:
     using ThreadInitCallBack = std::function<void(EventLoop *)>;
 
     EventLoopThread(const ThreadInitCallBack &cb = ThreadInitCallBack(),
-                    const std::string &name = std::string());
+                    const std::string &name = std::string(),
+                    PollerBackend backend = kDefaultPoller);
     ~EventLoopThread();
 
     EventLoop *startLoop();
@@ -28,4 +30,5 @@ private:
     std::mutex mutex_;
     std::condition_variable cond_;
     ThreadInitCallBack callback_;
+    PollerBackend backend_; // 新线程中的EventLoop使用的IO复用实现
 };
\ No newline at end of file
@@ -1,22 +1,40 @@
 #include "EventLoopThreadPool.h"
+#include "EventLoop.h"
 #include "EventLoopThread.h"
+#include "InetAddress.h"
 
 #include <memory>
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop,
                                          const std::string &nameArg)
     : baseLoop_(baseLoop), name_(nameArg), started_(false), numThreads_(0),
-      next_(0) {}
+      next_(0), policy_(kRoundRobin), randomState_(2463534242u),
+      backend_(kDefaultPoller) {}
 
 EventLoopThreadPool::~EventLoopThreadPool() {}
 
+void EventLoopThreadPool::setPollerBackend(int index, PollerBackend backend) {
+    if (index < 0) {
+        return;
+    }
+    if (static_cast<size_t>(index) >= loopBackends_.size()) {
+        loopBackends_.resize(index + 1, kDefaultPoller);
+    }
+    loopBackends_[index] = backend;
+}
+
 void EventLoopThreadPool::start(const ThreadInitCallBack &cb) {
     started_ = true;
 
     for (int i = 0; i < numThreads_; i++) {
         char buf[name_.size() + 32] = {0};
         snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-        EventLoopThread *t = new EventLoopThread(cb, buf);
+        PollerBackend backend = backend_;
+        if (static_cast<size_t>(i) < loopBackends_.size() &&
+            loopBackends_[i] != kDefaultPoller) {
+            backend = loopBackends_[i];
+        }
+        EventLoopThread *t = new EventLoopThread(cb, buf, backend);
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(
             t->startLoop()); // 底层创建线程，绑定一个新的EventLoop，并返回该loop的地址
@@ -41,6 +59,63 @@ EventLoop *EventLoopThreadPool::getNextLoop() {
     return loop;
 }
 
+EventLoop *EventLoopThreadPool::getLoopForConnection(
+    const InetAddress &peerAddr) {
+    if (loops_.size() <= 1 || policy_ == kRoundRobin) {
+        return getNextLoop();
+    }
+
+    const size_t n = loops_.size();
+    switch (policy_) {
+    case kLeastConnections: {
+        // 连接数相同时从上次的位置往后找，避免总是落在第一个loop
+        EventLoop *best = nullptr;
+        for (size_t i = 0; i < n; ++i) {
+            EventLoop *loop = loops_[(next_ + i) % n];
+            if (best == nullptr ||
+                loop->connectionCount() < best->connectionCount()) {
+                best = loop;
+            }
+        }
+        next_ = (next_ + 1) % n;
+        return best;
+    }
+    case kLeastBusy: {
+        EventLoop *best = nullptr;
+        for (size_t i = 0; i < n; ++i) {
+            EventLoop *loop = loops_[(next_ + i) % n];
+            if (best == nullptr ||
+                loop->recentBusyPermille() < best->recentBusyPermille() ||
+                (loop->recentBusyPermille() == best->recentBusyPermille() &&
+                 loop->connectionCount() < best->connectionCount())) {
+                best = loop;
+            }
+        }
+        next_ = (next_ + 1) % n;
+        return best;
+    }
+    case kPowerOfTwoChoices: {
+        // 只看两个loop，不用每次扫描所有loop，也不会让所有新连接同时挤向同一个最闲的loop
+        randomState_ ^= randomState_ << 13;
+        randomState_ ^= randomState_ >> 17;
+        randomState_ ^= randomState_ << 5;
+        size_t a = randomState_ % n;
+        size_t b = (a + 1 + (randomState_ >> 16) % (n - 1)) % n;
+        return loops_[a]->connectionCount() <= loops_[b]->connectionCount()
+                   ? loops_[a]
+                   : loops_[b];
+    }
+    case kHashByPeer: {
+        // 只按ip哈希，端口每次连接都不一样
+        uint32_t ip = peerAddr.getSockAddr()->sin_addr.s_addr;
+        uint32_t h = ip * 2654435761u;
+        return loops_[(h >> 16) % n];
+    }
+    default:
+        return getNextLoop();
+    }
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops() {
     if (loops_.empty()) {
         return std::vector<EventLoop *>(1, baseLoop_);
@@ -1,26 +1,48 @@
 #pragma once
+#include "Poller.h"
 #include "noncopyable.h"
 
 #include <functional>
 #include <memory>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool : noncopyable {
 public:
     using ThreadInitCallBack = std::function<void(EventLoop *)>;
+
+    // 新连接分配给哪个subLoop
+    enum DispatchPolicy {
+        kRoundRobin,        // 轮询
+        kLeastConnections,  // 当前连接数最少的loop
+        kLeastBusy,         // 最近一个统计窗口里最闲的loop
+        kPowerOfTwoChoices, // 随机选两个loop，取连接数少的那个
+        kHashByPeer,        // 按对端ip哈希，同一个客户端的连接总是落在同一个loop
+    };
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    // 所有subLoop使用的IO复用实现，需要在start之前设置
+    void setPollerBackend(PollerBackend backend) { backend_ = backend; }
+    // 单独指定第index个subLoop的IO复用实现，优先于setPollerBackend
+    void setPollerBackend(int index, PollerBackend backend);
 
     void start(const ThreadInitCallBack &cb = ThreadInitCallBack());
 
+    // 分配新连接的策略，默认轮询
+    void setDispatchPolicy(DispatchPolicy policy) { policy_ = policy; }
+
     // 如果工作在多线程中，baseLoop默认以轮训的方式分配Channel给subLoop
     EventLoop *getNextLoop();
+    // 按setDispatchPolicy设置的策略给来自peerAddr的新连接选一个loop
+    // 和getNextLoop一样只在baseLoop线程调用
+    EventLoop *getLoopForConnection(const InetAddress &peerAddr);
 
     std::vector<EventLoop *> getAllLoops();
 
@@ -33,6 +55,10 @@ private:
     bool started_;
     int numThreads_;
     int next_;
+    DispatchPolicy policy_;
+    uint32_t randomState_; // kPowerOfTwoChoices用的xorshift随机数状态
+    PollerBackend backend_;
+    std::vector<PollerBackend> loopBackends_; // 按下标单独指定的backend
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop *> loops_;
 };
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include "IoUringPoller.h"
+#include "Channel.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// channel未添加到poller中
+const int kNew = -1;
+// channel已添加到poller中
+const int kAdded = 1;
+// channel关注的事件为空，poll请求已经撤销
+const int kDeleted = 2;
+
+// 撤销poll请求产生的完成事件不需要处理
+const uint64_t kIgnoreUserData = 0;
+
+static int sysIoUringSetup(unsigned entries, io_uring_params *p) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+                           unsigned flags, void *arg, size_t argSize) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit,
+                                      minComplete, flags, arg, argSize));
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop), ringFd_(-1), sqRingPtr_(MAP_FAILED), sqRingSize_(0),
+      cqRingPtr_(MAP_FAILED), cqRingSize_(0),
+      sqes_(static_cast<io_uring_sqe *>(MAP_FAILED)), sqesSize_(0),
+      sqHead_(nullptr), sqTail_(nullptr), sqRingMask_(nullptr),
+      sqRingEntries_(nullptr), sqArray_(nullptr), cqHead_(nullptr),
+      cqTail_(nullptr), cqRingMask_(nullptr), cqes_(nullptr), sqLocalTail_(0),
+      toSubmit_(0), nextGeneration_(1), round_(0) {
+    if (!setupRing()) {
+        unmapRing();
+        if (ringFd_ >= 0) {
+            ::close(ringFd_);
+            ringFd_ = -1;
+        }
+    }
+}
+
+IoUringPoller::~IoUringPoller() {
+    unmapRing();
+    if (ringFd_ >= 0) {
+        ::close(ringFd_);
+    }
+}
+
+bool IoUringPoller::setupRing() {
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+    // 完成队列开大一些，multishot poll一个请求会产生多个完成事件
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER |
+                   IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = kRingEntries * 8;
+    ringFd_ = sysIoUringSetup(kRingEntries, &params);
+    if (ringFd_ < 0 && errno == EINVAL) {
+        // 老内核不认识后两个标志
+        memset(&params, 0, sizeof params);
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = kRingEntries * 8;
+        ringFd_ = sysIoUringSetup(kRingEntries, &params);
+    }
+    if (ringFd_ < 0) {
+        LOG_ERROR("io_uring_setup error:%d \n", errno);
+        return false;
+    }
+
+    // EXT_ARG用于带超时的等待（5.11），RSRC_TAGS和multishot poll同在5.13引入
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                              IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+    if ((params.features & required) != required) {
+        LOG_ERROR("io_uring features 0x%x not supported \n", params.features);
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    // SINGLE_MMAP：SQ和CQ共用一次映射
+    if (cqRingSize_ > sqRingSize_) {
+        sqRingSize_ = cqRingSize_;
+    }
+    cqRingSize_ = sqRingSize_;
+
+    sqRingPtr_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRingPtr_ == MAP_FAILED) {
+        LOG_ERROR("io_uring mmap sq ring error:%d \n", errno);
+        return false;
+    }
+    cqRingPtr_ = sqRingPtr_;
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(
+        ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+        LOG_ERROR("io_uring mmap sqes error:%d \n", errno);
+        return false;
+    }
+
+    char *sq = static_cast<char *>(sqRingPtr_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqRingMask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqRingEntries_ =
+        reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqLocalTail_ = *sqTail_;
+
+    char *cq = static_cast<char *>(cqRingPtr_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqRingMask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void IoUringPoller::unmapRing() {
+    if (sqes_ != MAP_FAILED) {
+        ::munmap(sqes_, sqesSize_);
+        sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+    }
+    if (sqRingPtr_ != MAP_FAILED) {
+        ::munmap(sqRingPtr_, sqRingSize_);
+        sqRingPtr_ = cqRingPtr_ = MAP_FAILED;
+    }
+}
+
+io_uring_sqe *IoUringPoller::getSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head >= *sqRingEntries_) {
+        // SQ满了，先把已有的请求提交给内核
+        enter(0, 0);
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqLocalTail_ - head >= *sqRingEntries_) {
+            LOG_FATAL("io_uring submission queue overflow \n");
+        }
+    }
+
+    unsigned index = sqLocalTail_ & *sqRingMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqArray_[index] = index;
+    ++sqLocalTail_;
+    ++toSubmit_;
+    // 让内核看到新的SQE
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+int IoUringPoller::enter(unsigned waitNr, int timeoutMs) {
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    void *argp = nullptr;
+    size_t argSize = 0;
+
+    if (waitNr > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutMs >= 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            memset(&arg, 0, sizeof arg);
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argSize = sizeof arg;
+        }
+    }
+
+    int ret = sysIoUringEnter(ringFd_, toSubmit_, waitNr, flags, argp, argSize);
+    if (ret >= 0) {
+        toSubmit_ -= static_cast<unsigned>(ret) < toSubmit_ ? ret : toSubmit_;
+    }
+    return ret;
+}
+
+void IoUringPoller::arm(int fd, PollState &state) {
+    Channel *channel = state.channel;
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    state.mask = static_cast<uint32_t>(channel->events() & ~EPOLLET);
+    sqe->poll32_events = state.mask;
+    // 边沿触发用multishot：注册一次，每次fd被唤醒都会产生完成事件
+    sqe->len = channel->edgeTriggered() ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = makeUserData(fd, state.generation);
+    state.armed = true;
+}
+
+void IoUringPoller::disarm(PollState &state) {
+    if (!state.armed) {
+        return;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(state.channel->fd(), state.generation);
+    sqe->user_data = kIgnoreUserData;
+    state.armed = false;
+    // 旧请求在撤销之前可能已经产生了完成事件，换一个代号把它们丢弃
+    state.generation = nextGeneration_++;
+    if (nextGeneration_ == 0) {
+        nextGeneration_ = 1;
+    }
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels) {
+    LOG_TRACE("func=%s => fd total count:%lu\n", __FUNCTION__,
+              numChannels());
+
+    // 上一轮处理完的单次poll在这里重新注册，和等待一起提交
+    for (int fd : rearmFds_) {
+        PollState *state = findState(fd);
+        if (state != nullptr && !state->armed &&
+            !state->channel->isNoneEvent()) {
+            arm(fd, *state);
+        }
+    }
+    rearmFds_.clear();
+
+    int ret = 0;
+    unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+        ret = enter(1, timeoutMs);
+    } else if (toSubmit_ > 0) {
+        // 已经有完成事件了，只提交不等待
+        ret = enter(0, 0);
+    }
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    if (ret < 0 && saveErrno != EINTR && saveErrno != ETIME &&
+        saveErrno != EBUSY) {
+        errno = saveErrno;
+        LOG_ERROR("IoUringPoller::poll() err:%d \n", saveErrno);
+    }
+
+    ++round_;
+    fillActiveChannels(activeChannels);
+    if (activeChannels->empty()) {
+        LOG_TRACE("%s timeout! \n", __FUNCTION__);
+    }
+    return now;
+}
+
+void IoUringPoller::fillActiveChannels(ChannelList *activeChannels) {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+        const io_uring_cqe &cqe = cqes_[head & *cqRingMask_];
+        if (cqe.user_data == kIgnoreUserData) {
+            continue;
+        }
+
+        int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+        uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32);
+        PollState *found = findState(fd);
+        if (found == nullptr || found->generation != generation) {
+            continue; // 已经撤销或者删除的请求
+        }
+
+        PollState &state = *found;
+        int revents = cqe.res;
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            // 单次poll已经完成，或者multishot被内核终止了，需要重新注册
+            state.armed = false;
+            if (cqe.res >= 0 || cqe.res == -ECANCELED) {
+                // 代号匹配的ECANCELED不是我们撤销的，而是内核取消的，重新注册即可
+                rearmFds_.push_back(fd);
+            }
+        }
+        if (cqe.res < 0) {
+            if (cqe.res == -ECANCELED) {
+                continue;
+            }
+            // 其他错误说明这个fd再也等不到事件了，不能悄悄丢掉，
+            // 按EPOLLERR|EPOLLHUP交给Channel，让handleError/handleClose去收尾
+            LOG_ERROR("io_uring poll fd=%d error:%d \n", fd, -cqe.res);
+            revents = EPOLLERR | EPOLLHUP;
+        }
+
+        Channel *channel = state.channel;
+        if (state.activeRound != round_) {
+            state.activeRound = round_;
+            channel->set_revents(revents);
+            activeChannels->push_back(channel);
+        } else {
+            // 同一轮中multishot可能产生多个完成事件，合并成一次回调
+            channel->set_revents(channel->revents() | revents);
+        }
+    }
+
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+void IoUringPoller::updateChannel(Channel *channel) {
+    const int index = channel->index();
+    const int fd = channel->fd();
+    LOG_TRACE("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, fd,
+              channel->events(), index);
+
+    if (index == kNew) {
+        addChannel(channel);
+        PollState state;
+        state.channel = channel;
+        state.generation = nextGeneration_++;
+        state.mask = 0;
+        state.armed = false;
+        state.activeRound = 0;
+        if (static_cast<size_t>(fd) >= states_.size()) {
+            states_.resize(fd * 2 + 1, PollState());
+        }
+        states_[fd] = state;
+    }
+
+    PollState &state = states_[fd];
+    if (index == kNew || index == kDeleted) {
+        channel->set_index(kAdded);
+        if (!channel->isNoneEvent()) {
+            arm(fd, state);
+        }
+    } else if (channel->isNoneEvent()) {
+        disarm(state);
+        channel->set_index(kDeleted);
+    } else if (!state.armed ||
+               state.mask != static_cast<uint32_t>(channel->events() &
+                                                   ~EPOLLET)) {
+        // 关注的事件变了，撤销旧的poll请求再重新注册
+        disarm(state);
+        arm(fd, state);
+    }
+}
+
+void IoUringPoller::removeChannel(Channel *channel) {
+    int fd = channel->fd();
+    eraseChannel(channel);
+    LOG_TRACE("func=%s => fd=%d\n", __FUNCTION__, fd);
+
+    PollState *state = findState(fd);
+    if (state != nullptr) {
+        disarm(*state);
+        state->channel = nullptr;
+    }
+    channel->set_index(kNew);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * 基于io_uring的Poller实现（不依赖liburing，直接使用系统调用）
+ *
+ * 每个关注事件的fd对应一个IORING_OP_POLL_ADD请求：
+ *  边沿触发的Channel使用multishot poll，注册一次之后一直产生完成事件
+ *  水平触发的Channel使用单次poll，事件处理完之后在下一次poll时重新注册，
+ *  重新注册时内核会立即检查fd状态，所以语义和epoll的LT一致
+ * 一轮循环里所有的注册、修改、删除请求都只放进SQ，和等待完成事件合并成一次io_uring_enter
+ *
+ * 需要内核支持IORING_FEAT_EXT_ARG（等待超时）和multishot poll（5.13+），
+ * 不支持时valid()返回false，由newDefaultPoller回退到epoll
+ */
+class IoUringPoller : public Poller {
+public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    // io_uring是否初始化成功
+    bool valid() const { return ringFd_ >= 0; }
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+
+private:
+    static const unsigned kRingEntries = 256;
+
+    // 每个fd在io_uring上的poll请求状态
+    struct PollState {
+        PollState()
+            : channel(nullptr), generation(0), mask(0), armed(false),
+              activeRound(0) {}
+        Channel *channel;
+        uint32_t generation; // 每次重新注册都会变化，用来丢弃过期的完成事件
+        uint32_t mask;       // 已注册的事件
+        bool armed;          // 当前是否有poll请求挂在内核中
+        uint64_t activeRound; // 最近一次被放入activeChannels的轮次
+    };
+    // 和Poller::channels_一样以fd为下标，channel为空表示没有注册
+    using PollStateList = std::vector<PollState>;
+
+    PollState *findState(int fd) {
+        return (fd >= 0 && static_cast<size_t>(fd) < states_.size() &&
+                states_[fd].channel != nullptr)
+                   ? &states_[fd]
+                   : nullptr;
+    }
+
+    bool setupRing();
+    void unmapRing();
+
+    io_uring_sqe *getSqe();
+    // 把SQ中的请求提交给内核，waitNr > 0时同时等待完成事件
+    int enter(unsigned waitNr, int timeoutMs);
+
+    void arm(int fd, PollState &state);
+    void disarm(PollState &state);
+    void fillActiveChannels(ChannelList *activeChannels);
+
+    static uint64_t makeUserData(int fd, uint32_t generation) {
+        return (static_cast<uint64_t>(generation) << 32) |
+               static_cast<uint32_t>(fd);
+    }
+
+    int ringFd_;
+
+    // SQ/CQ环形队列以及SQE数组的内存映射
+    void *sqRingPtr_;
+    size_t sqRingSize_;
+    void *cqRingPtr_;
+    size_t cqRingSize_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqRingMask_;
+    unsigned *sqRingEntries_;
+    unsigned *sqArray_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned *cqRingMask_;
+    io_uring_cqe *cqes_;
+
+    unsigned sqLocalTail_;
+    unsigned toSubmit_; // 已经放进SQ但还没有提交的请求个数
+
+    uint32_t nextGeneration_;
+    uint64_t round_;
+    PollStateList states_;
+    std::vector<int> rearmFds_; // 单次poll完成之后，等待下一轮重新注册的fd
+};
@@ -0,0 +1,107 @@
+#include "LogFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+LogFile::LogFile(const std::string &basename, off_t rollSize)
+    : basename_(basename), rollSize_(rollSize), fd_(-1), writtenBytes_(0),
+      startOfPeriod_(0), lastRoll_(0) {
+    rollFile();
+}
+
+LogFile::~LogFile() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void LogFile::append(const char *logline, size_t len) {
+    if (fd_ < 0) {
+        return;
+    }
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = ::write(fd_, logline + written, len - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // 这里不能再调用LOG_ERROR，否则会递归写日志
+            fprintf(stderr, "LogFile::append() failed %s\n", strerror(errno));
+            break;
+        }
+        written += n;
+    }
+    writtenBytes_ += written;
+
+    if (writtenBytes_ > rollSize_) {
+        rollFile();
+    } else {
+        time_t now = ::time(NULL);
+        time_t thisPeriod = now / kRollPerSeconds * kRollPerSeconds;
+        if (thisPeriod != startOfPeriod_) {
+            rollFile();
+        }
+    }
+}
+
+void LogFile::flush() {
+    if (fd_ >= 0) {
+        ::fdatasync(fd_);
+    }
+}
+
+bool LogFile::rollFile() {
+    time_t now = 0;
+    std::string filename = getLogFileName(basename_, &now);
+    time_t start = now / kRollPerSeconds * kRollPerSeconds;
+
+    // 同一秒内不重复滚动，否则文件名会冲突
+    if (now > lastRoll_) {
+        int fd = ::open(filename.c_str(),
+                        O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "LogFile::rollFile() open %s failed %s\n",
+                    filename.c_str(), strerror(errno));
+            return false;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        fd_ = fd;
+        lastRoll_ = now;
+        startOfPeriod_ = start;
+        writtenBytes_ = 0;
+        return true;
+    }
+    return false;
+}
+
+std::string LogFile::getLogFileName(const std::string &basename, time_t *now) {
+    std::string filename;
+    filename.reserve(basename.size() + 64);
+    filename = basename;
+
+    char timebuf[32];
+    tm tm_time;
+    *now = ::time(NULL);
+    localtime_r(now, &tm_time);
+    strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S.", &tm_time);
+    filename += timebuf;
+
+    char hostname[256] = {0};
+    if (::gethostname(hostname, sizeof hostname - 1) != 0) {
+        snprintf(hostname, sizeof hostname, "unknownhost");
+    }
+    filename += hostname;
+
+    char pidbuf[32];
+    snprintf(pidbuf, sizeof pidbuf, ".%d.log", ::getpid());
+    filename += pidbuf;
+
+    return filename;
+}
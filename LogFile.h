@@ -0,0 +1,38 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * 滚动日志文件，只由AsyncLogging的后台线程使用，所以不需要加锁
+ * 文件写满rollSize字节或者跨天之后，新建一个文件继续写
+ * 文件名：basename.20240101-120000.hostname.pid.log
+ */
+class LogFile : noncopyable {
+public:
+    LogFile(const std::string &basename, off_t rollSize);
+    ~LogFile();
+
+    // 直接调用::write，一次写入一整块日志缓冲区
+    void append(const char *logline, size_t len);
+    // 把内核页缓存里的日志落盘
+    void flush();
+
+    bool rollFile();
+
+private:
+    static std::string getLogFileName(const std::string &basename, time_t *now);
+
+    static const int kRollPerSeconds = 60 * 60 * 24;
+
+    const std::string basename_;
+    const off_t rollSize_;
+
+    int fd_;
+    off_t writtenBytes_;
+    time_t startOfPeriod_; // 当前文件所属的那一天
+    time_t lastRoll_;
+};
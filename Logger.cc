@@ -1,28 +1,79 @@
 #include "Logger.h"
 #include "Timestamp.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void defaultOutput(const char *msg, size_t len) {
+    ::fwrite(msg, 1, len, stdout);
+}
+
+static void defaultFlush() { ::fflush(stdout); }
+
+static int initLogLevel() {
+    const char *level = ::getenv("MUDUO_LOG_LEVEL");
+    if (level == nullptr) {
+        return INFO;
+    }
+    if (::strcmp(level, "TRACE") == 0) {
+        return TRACE;
+    } else if (::strcmp(level, "DEBUG") == 0) {
+        return DEBUG;
+    } else if (::strcmp(level, "ERROR") == 0) {
+        return ERROR;
+    }
+    return INFO;
+}
+
+Logger::Logger()
+    : logLevel_(initLogLevel()), output_(defaultOutput),
+      flush_(defaultFlush) {}
+
 Logger &Logger::instance() {
     static Logger logger;
     return logger;
 }
 
-void Logger::setLogLevel(int level) { logLevel_ = level; }
+void Logger::setOutput(OutputFunc out) { output_ = std::move(out); }
+
+void Logger::setFlush(FlushFunc flush) { flush_ = std::move(flush); }
 
-void Logger::log(std::string msg) {
-    switch (logLevel_) {
+void Logger::log(int level, const char *msg) {
+    const char *prefix = "";
+    switch (level) {
+    case TRACE:
+        prefix = "[TRACE]";
+        break;
     case INFO:
-        std::cout << "[INFO]";
+        prefix = "[INFO]";
         break;
     case ERROR:
-        std::cout << "[ERROR]";
+        prefix = "[ERROR]";
         break;
     case FATAL:
-        std::cout << "[FATAL]";
+        prefix = "[FATAL]";
         break;
     case DEBUG:
-        std::cout << "[DEBUG]";
+        prefix = "[DEBUG]";
         break;
     }
 
-    std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
+    // 先在栈上拼出完整的一行，再一次性交给output，多线程下行与行之间不会交错
+    char line[1280];
+    int n = snprintf(line, sizeof line, "%s%s : %s", prefix,
+                     Timestamp::now().toString().c_str(), msg);
+    if (n < 0) {
+        return;
+    }
+    size_t len = static_cast<size_t>(n) < sizeof line - 1 ? n : sizeof line - 2;
+    if (len == 0 || line[len - 1] != '\n') {
+        line[len++] = '\n';
+    }
+
+    output_(line, len);
+    // 进程马上要exit了，必须把缓冲中的日志刷出去
+    if (level == FATAL) {
+        flush_();
+    }
 }
@@ -1,69 +1,144 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <string>
 
 #include "noncopyable.h"
 
+/**
+ * 日志级别的两道过滤：
+ * 1. 编译期：低于MUDUO_MIN_LOG_LEVEL的宏展开为空语句，参数不会被求值
+ *    默认release构建去掉TRACE/DEBUG，定义MUDEBUG时全部保留，也可以用-D直接指定
+ * 2. 运行期：Logger::setLogLevel设置的阈值，在格式化之前判断，低于阈值的日志没有任何格式化开销
+ */
+#define MUDUO_LOG_LEVEL_TRACE 0
+#define MUDUO_LOG_LEVEL_DEBUG 1
+#define MUDUO_LOG_LEVEL_INFO 2
+#define MUDUO_LOG_LEVEL_ERROR 3
+#define MUDUO_LOG_LEVEL_FATAL 4
+
+#ifndef MUDUO_MIN_LOG_LEVEL
+#ifdef MUDEBUG
+#define MUDUO_MIN_LOG_LEVEL MUDUO_LOG_LEVEL_TRACE
+#else
+#define MUDUO_MIN_LOG_LEVEL MUDUO_LOG_LEVEL_INFO
+#endif
+#endif
+
+// 日志级别通过参数传给log，不再修改单例上的共享字段，避免多线程下级别串台
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_INFO
 #define LOG_INFO(logmsgFormat, ...)                                            \
     do {                                                                       \
         Logger &logger = Logger::instance();                                   \
-        logger.setLogLevel(INFO);                                              \
-        char buf[1024] = {0};                                                  \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);                      \
-        logger.log(buf);                                                       \
+        if (logger.shouldLog(INFO)) {                                          \
+            char buf[1024];                                                    \
+            snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);                  \
+            logger.log(INFO, buf);                                             \
+        }                                                                      \
+    } while (0)
+#else
+#define LOG_INFO(logmsgFormat, ...)                                            \
+    do {                                                                       \
     } while (0)
+#endif
 
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_ERROR
 #define LOG_ERROR(logmsgFormat, ...)                                           \
     do {                                                                       \
         Logger &logger = Logger::instance();                                   \
-        logger.setLogLevel(ERROR);                                             \
-        char buf[1024] = {0};                                                  \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);                      \
-        logger.log(buf);                                                       \
+        if (logger.shouldLog(ERROR)) {                                         \
+            char buf[1024];                                                    \
+            snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);                  \
+            logger.log(ERROR, buf);                                            \
+        }                                                                      \
     } while (0)
+#else
+#define LOG_ERROR(logmsgFormat, ...)                                           \
+    do {                                                                       \
+    } while (0)
+#endif
 
+// FATAL不受阈值影响，总是输出并退出进程
 #define LOG_FATAL(logmsgFormat, ...)                                           \
     do {                                                                       \
         Logger &logger = Logger::instance();                                   \
-        logger.setLogLevel(FATAL);                                             \
-        char buf[1024] = {0};                                                  \
+        char buf[1024];                                                        \
         snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);                      \
-        logger.log(buf);                                                       \
+        logger.log(FATAL, buf);                                                \
         exit(-1);                                                              \
     } while (0)
 
-#ifdef MUDEBUG
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_DEBUG
 #define LOG_DEBUG(logmsgFormat, ...)                                           \
     do {                                                                       \
         Logger &logger = Logger::instance();                                   \
-        logger.setLogLevel(DEBUG);                                             \
-        char buf[1024] = {0};                                                  \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);                      \
-        logger.log(buf);                                                       \
+        if (logger.shouldLog(DEBUG)) {                                         \
+            char buf[1024];                                                    \
+            snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);                  \
+            logger.log(DEBUG, buf);                                            \
+        }                                                                      \
     } while (0)
 #else
-#define LOG_DEBUG(logmsgFormat, ...)
+#define LOG_DEBUG(logmsgFormat, ...)                                           \
+    do {                                                                       \
+    } while (0)
 #endif
-// 定义日志的级别 INFO ERRPR FATAL DEBUG
 
+// 每个事件、每次poll都会打印的日志使用TRACE
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_TRACE
+#define LOG_TRACE(logmsgFormat, ...)                                           \
+    do {                                                                       \
+        Logger &logger = Logger::instance();                                   \
+        if (logger.shouldLog(TRACE)) {                                         \
+            char buf[1024];                                                    \
+            snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);                  \
+            logger.log(TRACE, buf);                                            \
+        }                                                                      \
+    } while (0)
+#else
+#define LOG_TRACE(logmsgFormat, ...)                                           \
+    do {                                                                       \
+    } while (0)
+#endif
+
+// 定义日志的级别，数值越大越重要，和上面的MUDUO_LOG_LEVEL_*一一对应
 enum LogLevel {
-    INFO,  // 普通信息
-    ERROR, // 错误信息
-    FATAL, // core信息
-    DEBUG, // 调试信息
+    TRACE = MUDUO_LOG_LEVEL_TRACE, // 每个事件的跟踪信息
+    DEBUG = MUDUO_LOG_LEVEL_DEBUG, // 调试信息
+    INFO = MUDUO_LOG_LEVEL_INFO,   // 普通信息
+    ERROR = MUDUO_LOG_LEVEL_ERROR, // 错误信息
+    FATAL = MUDUO_LOG_LEVEL_FATAL, // core信息
 };
 
 class Logger : noncopyable {
 public:
+    // 日志的输出目的地，默认是stdout，可以替换成AsyncLogging::append
+    using OutputFunc = std::function<void(const char *msg, size_t len)>;
+    using FlushFunc = std::function<void()>;
+
     // 获取日志唯一的实例对象
     static Logger &instance();
-    // 设置日志级别
-    void setLogLevel(int level);
-    // 写日志
-    void log(std::string msg);
+    // 写日志，一条完整的日志行只调用一次output
+    void log(int level, const char *msg);
+
+    // 运行期的日志阈值，低于该级别的日志在格式化之前就被丢弃
+    // 默认INFO，也可以通过环境变量MUDUO_LOG_LEVEL=TRACE/DEBUG/INFO/ERROR设置
+    void setLogLevel(int level) {
+        logLevel_.store(level, std::memory_order_relaxed);
+    }
+    int logLevel() const { return logLevel_.load(std::memory_order_relaxed); }
+    bool shouldLog(int level) const { return level >= logLevel(); }
+
+    // 需要在其他线程开始写日志之前设置
+    void setOutput(OutputFunc out);
+    void setFlush(FlushFunc flush);
 
 private:
-    int logLevel_;
-    Logger() {}
+    Logger();
+
+    std::atomic_int logLevel_;
+    OutputFunc output_;
+    FlushFunc flush_;
 };
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <utility>
+
+/**
+ * 无锁的多生产者单消费者队列（Dmitry Vyukov的MPSC链表队列，带节点池）
+ * 生产者：任意线程调用push，只有一次原子exchange，不会互相阻塞
+ * 消费者：只能是一个线程（EventLoop所在线程）调用drain/empty
+ *
+ * tail_指向一个"哑节点"，它的值已经被消费过了，真正的数据从tail_->next开始
+ * 生产者在exchange之后、链接next之前被抢占时，消费者会暂时看不到后面的节点，
+ * 生产者链接完成后总会调用wakeup，所以这些节点会在下一轮被消费
+ *
+ * 节点不是侵入式嵌在元素里的，而是循环复用：消费者把用完的节点整串挂回freeList_，
+ * 生产者的线程局部缓存用光时，用一次exchange把freeList_整个取走。
+ * freeList_只有消费者一个线程压入、生产者只做"整体取走"，所以没有ABA问题。
+ * 稳定状态下push/drain不再调用new/delete，节点池的大小等于历史上积压的峰值
+ */
+template <typename T>
+class MpscQueue : noncopyable {
+public:
+    MpscQueue() : head_(new Node), tail_(head_.load()), freeList_(nullptr) {}
+
+    ~MpscQueue() {
+        deleteList(tail_);
+        deleteList(freeList_.load(std::memory_order_acquire));
+    }
+
+    // 多个线程可以同时调用
+    void push(T value) {
+        Node *node = allocNode(std::move(value));
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 只消费调用时刻已经入队的元素，func执行期间新入队的元素留给下一次drain
+    // 返回本次消费的元素个数
+    template <typename Func>
+    size_t drain(Func &&func) {
+        Node *last = head_.load(std::memory_order_acquire);
+        Node *freeFirst = nullptr;
+        Node *freeLast = nullptr;
+        size_t count = 0;
+        while (tail_ != last) {
+            Node *next = tail_->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                break; // 生产者还没有完成链接
+            }
+            T value(std::move(next->value));
+            // 旧的哑节点串到本地链表上，最后一次性还给节点池
+            tail_->next.store(freeFirst, std::memory_order_relaxed);
+            if (freeFirst == nullptr) {
+                freeLast = tail_;
+            }
+            freeFirst = tail_;
+            tail_ = next; // next成为新的哑节点
+            func(value);
+            ++count;
+        }
+        if (freeFirst != nullptr) {
+            recycle(freeFirst, freeLast);
+        }
+        return count;
+    }
+
+    // 只能在消费者线程调用
+    bool empty() const {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        Node() : next(nullptr) {}
+        explicit Node(T v) : next(nullptr), value(std::move(v)) {}
+        std::atomic<Node *> next;
+        T value;
+    };
+
+    // 每个生产者线程缓存一串空闲节点，线程退出时释放
+    // 同一种T的所有队列共享这份缓存，节点在队列之间流动也没有关系
+    struct NodeCache {
+        NodeCache() : head(nullptr) {}
+        ~NodeCache() { deleteList(head); }
+        Node *head;
+    };
+
+    static NodeCache &localCache() {
+        static thread_local NodeCache cache;
+        return cache;
+    }
+
+    static void deleteList(Node *node) {
+        while (node != nullptr) {
+            Node *next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    Node *allocNode(T &&value) {
+        NodeCache &cache = localCache();
+        if (cache.head == nullptr) {
+            cache.head = freeList_.exchange(nullptr, std::memory_order_acquire);
+        }
+        Node *node = cache.head;
+        if (node == nullptr) {
+            return new Node(std::move(value));
+        }
+        cache.head = node->next.load(std::memory_order_relaxed);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->value = std::move(value);
+        return node;
+    }
+
+    // 只有消费者线程调用，把first..last这一串节点挂回freeList_
+    void recycle(Node *first, Node *last) {
+        Node *top = freeList_.load(std::memory_order_relaxed);
+        do {
+            last->next.store(top, std::memory_order_relaxed);
+        } while (!freeList_.compare_exchange_weak(top, first,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed));
+    }
+
+    std::atomic<Node *> head_;     // 生产者从这里入队
+    Node *tail_;                   // 消费者从这里出队
+    std::atomic<Node *> freeList_; // 消费者归还、生产者整体取走的空闲节点
+};
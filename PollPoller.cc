@@ -0,0 +1,93 @@
+#include "PollPoller.h"
+#include "Channel.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <sys/epoll.h>
+
+PollPoller::PollPoller(EventLoop *loop) : Poller(loop) {}
+
+PollPoller::~PollPoller() = default;
+
+Timestamp PollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
+    int numEvents = ::poll(pollfds_.data(), pollfds_.size(), timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    if (numEvents > 0) {
+        fillActiveChannels(numEvents, activeChannels);
+    } else if (numEvents == 0) {
+        LOG_TRACE("%s timeout! \n", __FUNCTION__);
+    } else {
+        if (saveErrno != EINTR) {
+            errno = saveErrno;
+            LOG_ERROR("PollPoller::poll() err!");
+        }
+    }
+    return now;
+}
+
+void PollPoller::fillActiveChannels(int numEvents,
+                                    ChannelList *activeChannels) const {
+    for (PollFdList::const_iterator pfd = pollfds_.begin();
+         pfd != pollfds_.end() && numEvents > 0; ++pfd) {
+        if (pfd->revents > 0) {
+            --numEvents;
+            Channel *channel = findChannel(pfd->fd);
+            if (channel == nullptr) {
+                continue;
+            }
+            // POLLIN/POLLPRI/POLLOUT/POLLERR/POLLHUP 和 EPOLL* 的取值相同
+            channel->set_revents(pfd->revents);
+            activeChannels->push_back(channel);
+        }
+    }
+}
+
+void PollPoller::updateChannel(Channel *channel) {
+    LOG_TRACE("func=%s => fd=%d events=%d \n", __FUNCTION__, channel->fd(),
+              channel->events());
+    // poll没有边沿触发，这里只取普通的事件位
+    short events = static_cast<short>(channel->events() & ~EPOLLET);
+
+    if (channel->index() < 0) {
+        // 新的channel，追加到数组末尾
+        struct pollfd pfd;
+        pfd.fd = channel->fd();
+        pfd.events = events;
+        pfd.revents = 0;
+        pollfds_.push_back(pfd);
+        channel->set_index(static_cast<int>(pollfds_.size()) - 1);
+        addChannel(channel);
+    } else {
+        struct pollfd &pfd = pollfds_[channel->index()];
+        pfd.fd = channel->fd();
+        pfd.events = events;
+        pfd.revents = 0;
+        if (channel->isNoneEvent()) {
+            // 负数的fd会被poll忽略，-fd-1保证fd为0时也是负数
+            pfd.fd = -channel->fd() - 1;
+        }
+    }
+}
+
+void PollPoller::removeChannel(Channel *channel) {
+    LOG_TRACE("func=%s => fd=%d\n", __FUNCTION__, channel->fd());
+    int idx = channel->index();
+    eraseChannel(channel);
+
+    if (idx >= 0 && static_cast<size_t>(idx) < pollfds_.size()) {
+        if (static_cast<size_t>(idx) != pollfds_.size() - 1) {
+            // 和最后一个元素交换后再pop_back，O(1)删除
+            int channelAtEnd = pollfds_.back().fd;
+            std::iter_swap(pollfds_.begin() + idx, pollfds_.end() - 1);
+            if (channelAtEnd < 0) {
+                channelAtEnd = -channelAtEnd - 1;
+            }
+            findChannel(channelAtEnd)->set_index(idx);
+        }
+        pollfds_.pop_back();
+    }
+    channel->set_index(-1);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <poll.h>
+#include <vector>
+
+/**
+ * 基于poll(2)的Poller实现
+ * 所有关注的fd放在一个连续的pollfd数组中，Channel的index就是它在数组中的下标
+ * 注册和修改事件只修改用户态数组，没有epoll_ctl系统调用，
+ * 适合只管理少量fd的loop（监听socket、wakeupfd、timerfd等）
+ */
+class PollPoller : public Poller {
+public:
+    PollPoller(EventLoop *loop);
+    ~PollPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+
+    // poll没有边沿触发，EPOLLOUT常驻注册会导致poll一直返回
+    bool supportsEdgeTriggered() const override { return false; }
+
+private:
+    void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
+
+    using PollFdList = std::vector<struct pollfd>;
+    PollFdList pollfds_;
+};
@@ -1,11 +1,58 @@
 #include "Poller.h"
 #include "Channel.h"
 
-Poller::Poller(EventLoop *loop) : ownerLoop_(loop) {}
+#include <assert.h>
+
+Poller::Poller(EventLoop *loop) : numChannels_(0), ownerLoop_(loop) {}
 
 bool Poller::hasChannel(Channel *channel) const {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
+    return findChannel(channel->fd()) == channel;
+}
+
+void Poller::addChannel(Channel *channel) {
+    const int fd = channel->fd();
+    assert(fd >= 0);
+    if (static_cast<size_t>(fd) >= channels_.size()) {
+        // 按2倍增长，避免fd逐个增大时反复扩容
+        size_t newSize = channels_.empty() ? 64 : channels_.size();
+        while (newSize <= static_cast<size_t>(fd)) {
+            newSize *= 2;
+        }
+        channels_.resize(newSize, nullptr);
+    }
+
+    // 同一个fd同时只能属于一个Channel
+    assert(channels_[fd] == nullptr || channels_[fd] == channel);
+    if (channels_[fd] == nullptr) {
+        ++numChannels_;
+    }
+    channels_[fd] = channel;
+    assertInvariants();
 }
 
+void Poller::eraseChannel(Channel *channel) {
+    const int fd = channel->fd();
+    if (fd < 0 || static_cast<size_t>(fd) >= channels_.size()) {
+        return;
+    }
+    assert(channels_[fd] == nullptr || channels_[fd] == channel);
+    if (channels_[fd] == channel) {
+        channels_[fd] = nullptr;
+        --numChannels_;
+    }
+    assertInvariants();
+}
 
+void Poller::assertInvariants() const {
+#ifdef MUDEBUG
+    // 全量检查，只在调试构建中打开
+    size_t count = 0;
+    for (size_t fd = 0; fd < channels_.size(); ++fd) {
+        if (channels_[fd] != nullptr) {
+            assert(channels_[fd]->fd() == static_cast<int>(fd));
+            ++count;
+        }
+    }
+    assert(count == numChannels_);
+#endif
+}
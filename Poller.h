@@ -3,12 +3,20 @@
 #include "Timestamp.h"
 #include "noncopyable.h"
 
-#include <unordered_map>
+#include <cstddef>
 #include <vector>
 
 class Channel;
 class EventLoop;
 
+// IO复用的具体实现，每个EventLoop可以单独选择
+enum PollerBackend {
+    kDefaultPoller, // 由环境变量决定：MUDUO_USE_IO_URING / MUDUO_USE_POLL / epoll
+    kEPollPoller,
+    kPollPoller,    // 适合只有少量fd的loop，没有epoll_ctl开销
+    kIoUringPoller, // 内核不支持时回退到epoll
+};
+
 // muduo库中多路事件分发器的核心IO复用模块
 class Poller {
 public:
@@ -27,14 +35,33 @@ public:
     // 判断参数channel是否在当前Poller当中
     bool hasChannel(Channel *channel) const;
 
+    // 是否支持边沿触发，不支持时边沿触发的Channel会退回水平触发
+    virtual bool supportsEdgeTriggered() const { return true; }
+
     // EventLoop可以通过该接口获取默认的IO复用的具体实现
     static Poller *newDefaultPoller(EventLoop *loop);
+    // 创建指定的IO复用实现
+    static Poller *newPoller(EventLoop *loop, PollerBackend backend);
 
 protected:
-    // map的key：sockfd value：sockfd所属的channel通道类型
-    using ChannelMap = std::unordered_map<int, Channel *>;
-    ChannelMap channels_;
+    // fd -> Channel* 的映射，所有Poller实现共用
+    // fd是内核分配的最小可用整数，小而稠密，直接用fd做数组下标，
+    // 注册和删除都不需要哈希和分配节点，数组只在出现更大的fd时增长
+    void addChannel(Channel *channel);
+    void eraseChannel(Channel *channel);
+    Channel *findChannel(int fd) const {
+        return (fd >= 0 && static_cast<size_t>(fd) < channels_.size())
+                   ? channels_[fd]
+                   : nullptr;
+    }
+    size_t numChannels() const { return numChannels_; }
 
 private:
+    // 调试模式下检查channels_和numChannels_是否一致
+    void assertInvariants() const;
+
+    std::vector<Channel *> channels_;
+    size_t numChannels_;
+
     EventLoop *ownerLoop_; // 定义Poller所属的事件循环EventLoop
 };
\ No newline at end of file
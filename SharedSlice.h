@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * 引用计数的只读数据片段
+ * 数据本身放在shared_ptr<const std::string>里，拷贝SharedSlice只增加引用计数，
+ * 同一份数据（比如广播的消息、缓存的响应）可以同时交给多个连接发送，不会拷贝数据
+ */
+class SharedSlice {
+public:
+    SharedSlice() : offset_(0), length_(0) {}
+
+    // 接管data的内容
+    explicit SharedSlice(std::string &&data)
+        : data_(std::make_shared<const std::string>(std::move(data))),
+          offset_(0), length_(data_->size()) {}
+
+    SharedSlice(std::shared_ptr<const std::string> data, size_t offset,
+                size_t length)
+        : data_(std::move(data)), offset_(offset), length_(length) {}
+
+    const char *data() const {
+        return data_ ? data_->data() + offset_ : nullptr;
+    }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+
+    // 共享同一份数据的子片段
+    SharedSlice slice(size_t offset, size_t length) const {
+        return SharedSlice(data_, offset_ + offset, length);
+    }
+
+private:
+    std::shared_ptr<const std::string> data_;
+    size_t offset_;
+    size_t length_;
+};
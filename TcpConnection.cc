@@ -5,12 +5,20 @@
 #include "Socket.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <functional>
+#include <limits.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <string.h>
 #include <string>
 #include <strings.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop) {
     if (loop == nullptr) {
@@ -23,10 +31,27 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop) {
 TcpConnection::TcpConnection(EventLoop *loop, const std::string &nameArg,
                              int sockfd, const InetAddress &loaclAddr,
                              const InetAddress &peerAddr)
-    : loop_(CheckLoopNotNull(loop)), name_(nameArg), state_(kConnecting),
-      reading_(true), socket_(new Socket(sockfd)),
+    : TcpConnection(loop, 0, nullptr, sockfd, loaclAddr, peerAddr) {
+    name_ = nameArg;
+}
+
+TcpConnection::TcpConnection(EventLoop *loop, uint64_t id,
+                             std::shared_ptr<const std::string> namePrefix,
+                             int sockfd, const InetAddress &loaclAddr,
+                             const InetAddress &peerAddr)
+    : loop_(CheckLoopNotNull(loop)), id_(id),
+      namePrefix_(std::move(namePrefix)), state_(kConnecting),
+      readPaused_(0), socket_(new Socket(sockfd)),
       channel_(new Channel(loop, sockfd)), localAddr_(loaclAddr),
-      peerAddr_(peerAddr), highWaterMark_(64 * 1024 * 1024) {
+      peerAddr_(peerAddr), highWaterMark_(64 * 1024 * 1024),
+      hasThrottledReader_(false), readerPaused_(false), lowWaterMark_(0),
+      queuedBytes_(0),
+      queuedFileBytes_(0), relayPipeBytes_(0), relayEof_(false),
+      relayFinished_(false), zeroCopyThreshold_(0), zeroCopyNextId_(0),
+      zeroCopySends_(0), zeroCopyCopied_(0),
+      idleWheel_(nullptr), idleEntry_(nullptr), reclaimEntry_(nullptr),
+      chainedBuffers_(false), autoCork_(false), corkFlushScheduled_(false),
+      accountedBytes_(0), accountedMemory_(0) {
     // 下面给channel设置相应的回调函数，
     // poller给channel通知感兴趣的事件发生了，channel会回调相应的操作
     channel_->setReadCallBack(
@@ -35,21 +60,51 @@ TcpConnection::TcpConnection(EventLoop *loop, const std::string &nameArg,
     channel_->setCloseCallBack(std::bind(&TcpConnection::handleClose, this));
     channel_->setErrorCallBack(std::bind(&TcpConnection::handleError, this));
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
+    LOG_DEBUG("TcpConnection::ctor[%s] at fd=%d\n", name().c_str(), sockfd);
     socket_->setKeepAlive(true);
+    relayPipe_[0] = relayPipe_[1] = -1;
+    // 构造时就计入，baseLoop连续分配连接时能马上看到
+    loop_->addConnectionCount(1);
+}
+
+// 大部分连接从来不需要名字，只有日志或者用户用到时才格式化
+// 可能在多个线程里同时第一次调用，用call_once保证只拼一次
+const std::string &TcpConnection::name() const {
+    std::call_once(nameOnce_, [this]() {
+        if (namePrefix_) {
+            name_ = *namePrefix_ + "#" + std::to_string(id_);
+        }
+    });
+    return name_;
 }
 
 TcpConnection::~TcpConnection() {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", name_.c_str(),
+    LOG_DEBUG("TcpConnection::dtor[%s] at fd=%d state=%d \n", name().c_str(),
              channel_->fd(), (int)state_);
+    if (relaying()) {
+        ::close(relayPipe_[0]);
+        ::close(relayPipe_[1]);
+    }
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime) {
+    if (relaying()) {
+        handleRelayRead();
+        return;
+    }
+
     int saveErrno = 0;
-    size_t n = inputBuffer_.readFd(channel_->fd(), &saveErrno);
+    ssize_t n = inputBuffer_.readFd(channel_->fd(), &saveErrno);
+    if (channel_->edgeTriggered()) {
+        handleReadEdgeTriggered(n, saveErrno, receiveTime);
+        return;
+    }
+
     if (n > 0) {
+        touchIdle();
         // 已建立连接的用于，有可读事件发生了，调用用户传入的回调操作
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        updateBufferStats();
     } else if (n == 0) {
         handleClose();
     } else {
@@ -59,36 +114,121 @@ void TcpConnection::handleRead(Timestamp receiveTime) {
     }
 }
 
+// 边沿触发只通知一次，必须一直读到EAGAIN，读完之后只回调一次messageCallback_
+void TcpConnection::handleReadEdgeTriggered(ssize_t n, int saveErrno,
+                                            Timestamp receiveTime) {
+    size_t total = 0;
+    while (n > 0) {
+        total += n;
+        n = inputBuffer_.readFd(channel_->fd(), &saveErrno);
+    }
+
+    if (total > 0) {
+        touchIdle();
+        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        updateBufferStats();
+    }
+    if (n == 0) {
+        if (state_ != kDisConnected) {
+            handleClose();
+        }
+    } else if (saveErrno != EAGAIN && saveErrno != EWOULDBLOCK) {
+        errno = saveErrno;
+        LOG_ERROR("TcpConnection::handleRead");
+        handleError();
+    }
+}
+
 // 把输出缓冲区可读的数据写到fd中
+// 水平触发：每次EPOLLOUT写一次，没写完poller会继续通知，写完后注销EPOLLOUT
+// 边沿触发：EPOLLOUT一直注册着，每次一直写到EAGAIN或者缓冲区写空
 void TcpConnection::handleWrite() {
-    if (channel_->isWriting()) {
+    const bool edgeTriggered = channel_->edgeTriggered();
+    if (!edgeTriggered && !channel_->isWriting()) {
+        LOG_ERROR("TcpConnection fd = %d is down, no more writing \n",
+                  channel_->fd());
+        return;
+    }
+    // 水平触发每次EPOLLOUT只写一次，边沿触发要一直写到EAGAIN
+    flushOutput(edgeTriggered);
+}
+
+// 自动合并模式下，本轮事件处理完之后由loop调用，把这一轮send的数据一起写出去
+void TcpConnection::flushCorked() {
+    corkFlushScheduled_ = false;
+    if (state_ == kDisConnected || pendingOutputBytes() == 0) {
+        return;
+    }
+    if (!channel_->edgeTriggered() && channel_->isWriting()) {
+        // 已经在等EPOLLOUT了，交给handleWrite
+        return;
+    }
+    flushOutput(true);
+}
+
+void TcpConnection::scheduleCorkFlush() {
+    if (!corkFlushScheduled_) {
+        corkFlushScheduled_ = true;
+        loop_->runAfterDispatch(
+            std::bind(&TcpConnection::flushCorked, shared_from_this()));
+    }
+}
+
+void TcpConnection::flushOutput(bool untilBlocked) {
+    const bool edgeTriggered = channel_->edgeTriggered();
+    bool wrote = false;
+    while (pendingOutputBytes() > 0) {
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0) {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0) {
-                // 输出缓冲区的数据写完了所以不可写了
-                channel_->disableWriting();
-                if (writeCompleteCallback_) {
-                    // 唤醒loop_对应的thread线程执行回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this()));
-                }
-                if (state_ == kDisConnecting) {
-                    shutdownInLoop();
-                }
+        ssize_t n = writeOutput(&savedErrno);
+        if (n <= 0) {
+            if (!untilBlocked || (savedErrno != EAGAIN &&
+                                  savedErrno != EWOULDBLOCK)) {
+                LOG_ERROR("TcpConnectio::handleWrite");
             }
-        } else {
-            LOG_ERROR("TcpConnectio::handleWrite");
+            break;
+        }
+        wrote = true;
+        touchIdle();
+        retrieveOutput(n);
+        updateBackpressure();
+        if (!untilBlocked) {
+            break;
+        }
+    }
+
+    if (pendingOutputBytes() > 0 && !edgeTriggered &&
+        !channel_->isWriting()) {
+        // 合并写没有写完，剩下的等EPOLLOUT
+        channel_->enableWriting();
+    }
+
+    if (wrote && pendingOutputBytes() == 0) {
+        // 输出缓冲区的数据写完了所以不可写了
+        if (!edgeTriggered) {
+            channel_->disableWriting();
+        }
+        if (writeCompleteCallback_) {
+            // 唤醒loop_对应的thread线程执行回调
+            loop_->queueInLoop(
+                std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+        if (state_ == kDisConnecting) {
+            shutdownInLoop();
+        }
+    }
+    updateBufferStats();
+
+    if (pendingOutputBytes() == 0) {
+        // 自己的数据发完了，再继续发别的连接转发过来的数据
+        TcpConnectionPtr source = relaySource_.lock();
+        if (source) {
+            source->resumeRelay();
         }
-    } else {
-        LOG_ERROR("TcpConnection fd = %d is down, no more writing \n",
-                  channel_->fd());
     }
 }
 // poller 通知调用 channel::closeCallback => TcpConnection::handleClose
 void TcpConnection::handleClose() {
-    LOG_INFO("fd=%d state=%d \n", channel_->fd(), (int)state_);
+    LOG_DEBUG("fd=%d state=%d \n", channel_->fd(), (int)state_);
     setState(kDisConnected);
     channel_->disableAll();
 
@@ -98,6 +238,9 @@ void TcpConnection::handleClose() {
 }
 
 void TcpConnection::handleError() {
+    // MSG_ZEROCOPY的完成通知放在socket的错误队列里，也是通过EPOLLERR通知的
+    bool notified = !zeroCopyPending_.empty() && handleZeroCopyCompletions();
+
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
@@ -107,8 +250,11 @@ void TcpConnection::handleError() {
     } else {
         err = optval;
     }
+    if (notified && err == 0) {
+        return;
+    }
     LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n",
-              name_.c_str(), err);
+              name().c_str(), err);
 }
 
 void TcpConnection::send(const std::string &buf) {
@@ -117,23 +263,223 @@ void TcpConnection::send(const std::string &buf) {
             sendInLoop(buf.c_str(), buf.size());
 
         } else {
-            loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this,
-                                       buf.c_str(), buf.size()));
+            // 调用者的buf在sendInLoop执行之前可能就已经销毁了，只能拷贝一份
+            send(std::string(buf));
         }
     }
 }
 
+void TcpConnection::send(std::string &&buf) {
+    if (state_ == kConnected) {
+        if (loop_->isInLoopThread()) {
+            sendStringInLoop(buf);
+        } else {
+            // 字符串移动进回调里，不拷贝数据
+            loop_->runInLoop(std::bind(&TcpConnection::sendStringInLoop,
+                                       shared_from_this(), std::move(buf)));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf) {
+    if (state_ == kConnected) {
+        if (loop_->isInLoopThread()) {
+            sendBufferInLoop(buf);
+        } else {
+            // 把buf的内容换到一个新的Buffer里交给loop线程，buf被清空
+            std::shared_ptr<Buffer> payload(new Buffer());
+            payload->swap(*buf);
+            TcpConnectionPtr self(shared_from_this());
+            loop_->runInLoop(
+                [self, payload]() { self->sendBufferInLoop(payload.get()); });
+        }
+    }
+}
+
+void TcpConnection::send(const SharedSlice &slice) {
+    if (state_ == kConnected) {
+        if (loop_->isInLoopThread()) {
+            sendSliceInLoop(slice);
+        } else {
+            // 只增加引用计数
+            loop_->runInLoop(std::bind(&TcpConnection::sendSliceInLoop,
+                                       shared_from_this(), slice));
+        }
+    }
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t length) {
+    if (state_ != kConnected || length == 0) {
+        return;
+    }
+    int dupFd = ::dup(fd);
+    if (dupFd < 0) {
+        LOG_ERROR("TcpConnection::sendFile dup fd=%d errno=%d \n", fd, errno);
+        return;
+    }
+    std::shared_ptr<FileRange> file(new FileRange(dupFd, offset, length));
+    if (loop_->isInLoopThread()) {
+        sendFileInLoop(file);
+    } else {
+        loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop,
+                                   shared_from_this(), file));
+    }
+}
+
+TcpConnection::FileRange::~FileRange() { ::close(fd); }
+
+void TcpConnection::sendFileInLoop(const std::shared_ptr<FileRange> &file) {
+    if (state_ == kDisConnected) {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+
+    OutputSegment segment;
+    segment.file = file;
+    queueAndFlush(std::move(segment));
+}
+
+// 整个数据段排队，之前没有待发送的数据时直接开始发送，不用等下一次EPOLLOUT
+void TcpConnection::queueAndFlush(OutputSegment &&segment) {
+    bool idle = !outputPending();
+    size_t oldLen = bufferedOutputBytes();
+    queueSegment(std::move(segment));
+    if (idle && autoCork_) {
+        scheduleCorkFlush();
+    }
+    outputQueued(oldLen);
+    if (idle && !autoCork_) {
+        handleWrite();
+    }
+}
+
+// 没有直接写完的部分作为数据段排队，字符串本身移动进去，不拷贝
+void TcpConnection::sendStringInLoop(std::string &message) {
+    if (state_ == kDisConnected) {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+
+    size_t len = message.size();
+    if (zeroCopyEligible(len)) {
+        // 不先write，整个交给writeOutput用MSG_ZEROCOPY发送
+        OutputSegment segment;
+        segment.slice = SharedSlice(std::move(message));
+        queueAndFlush(std::move(segment));
+        return;
+    }
+
+    bool faultError = false;
+    size_t nwrote = writeDirectly(message.data(), len, &faultError);
+    if (!faultError && nwrote < len) {
+        size_t oldLen = bufferedOutputBytes();
+        OutputSegment segment;
+        segment.slice =
+            SharedSlice(std::move(message)).slice(nwrote, len - nwrote);
+        queueSegment(std::move(segment));
+        outputQueued(oldLen);
+    }
+}
+
+void TcpConnection::sendSliceInLoop(const SharedSlice &slice) {
+    if (state_ == kDisConnected) {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+
+    if (zeroCopyEligible(slice.size())) {
+        OutputSegment segment;
+        segment.slice = slice;
+        queueAndFlush(std::move(segment));
+        return;
+    }
+
+    bool faultError = false;
+    size_t nwrote = writeDirectly(slice.data(), slice.size(), &faultError);
+    if (!faultError && nwrote < slice.size()) {
+        size_t oldLen = bufferedOutputBytes();
+        OutputSegment segment;
+        segment.slice = slice.slice(nwrote, slice.size() - nwrote);
+        queueSegment(std::move(segment));
+        outputQueued(oldLen);
+    }
+}
+
+void TcpConnection::setEdgeTriggered(bool on) {
+    channel_->setEdgeTriggered(on);
+}
+
+bool TcpConnection::outputPending() const {
+    if (channel_->edgeTriggered()) {
+        return pendingOutputBytes() > 0;
+    }
+    return channel_->isWriting() || pendingOutputBytes() > 0;
+}
+
 void TcpConnection::connectEstablished() {
     setState(kConnected);
     // TcpConnection 绑定了一个 channel 调用的回调存在于 TcpConnection
     // tie 方法能够确保TcpConnection存在
     channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的epollin事件
+    if (channel_->edgeTriggered() && !loop_->supportsEdgeTriggered()) {
+        // 所属loop的Poller（比如poll）不支持边沿触发，退回水平触发
+        channel_->setEdgeTriggered(false);
+    }
+    if (channel_->edgeTriggered()) {
+        // 边沿触发：读写事件一次注册好，之后不再因为发送而epoll_ctl
+        channel_->enableAll();
+    } else {
+        channel_->enableReading(); // 向poller注册channel的epollin事件
+    }
+    if (chainedBuffers_) {
+        inputBuffer_.setBlockPool(loop_->bufferPool());
+        outputBuffer_.setBlockPool(loop_->bufferPool());
+    }
+    updateBufferStats();
 
     // 新连接建立 执行回调
     connectionCallback_(shared_from_this());
 }
 
+/**
+ * 连接销毁时还没有收到完成通知的MSG_ZEROCOPY发送
+ * 内核的skb还引用着这些内存，现在释放的话，内存被重新分配之后发出去的就是别的数据
+ * dup一份socket让错误队列还能读，由loop按退避的间隔去读完成通知，全部完成才释放数据、关闭socket
+ * 对端一直不收数据时，最多等kMaxSeconds，之后关闭socket并故意泄漏这些数据
+ */
+struct TcpConnection::ZeroCopyLinger : noncopyable {
+    static const double kFirstInterval;
+    static const double kMaxInterval;
+    static const double kMaxSeconds;
+
+    EventLoop *loop;
+    int fd;
+    ZeroCopyPending pending;
+    uint64_t copied;
+    double interval;
+    Timestamp deadline;
+
+    ZeroCopyLinger(EventLoop *loop, int fd, ZeroCopyPending &&pending)
+        : loop(loop), fd(fd), pending(std::move(pending)), copied(0),
+          interval(kFirstInterval),
+          deadline(addTime(Timestamp::now(), kMaxSeconds)) {}
+
+    ~ZeroCopyLinger() {
+        if (!pending.empty()) {
+            // 超时或者loop已经退出：内核可能还在读这些内存，宁可泄漏也不能释放
+            LOG_ERROR("fd=%d %zu zerocopy sends never completed, leaking "
+                      "their buffers \n",
+                      fd, pending.size());
+            new ZeroCopyPending(std::move(pending));
+        }
+        ::close(fd);
+    }
+};
+
+const double TcpConnection::ZeroCopyLinger::kFirstInterval = 0.01;
+const double TcpConnection::ZeroCopyLinger::kMaxInterval = 1.0;
+const double TcpConnection::ZeroCopyLinger::kMaxSeconds = 60.0;
+
 void TcpConnection::connectDestoryed() {
     if (state_ == kConnected) {
         setState(kDisConnected);
@@ -141,6 +487,56 @@ void TcpConnection::connectDestoryed() {
 
         connectionCallback_(shared_from_this());
     }
+    // TcpServer析构时正在关闭的连接也走到这里，之后排队的forceCloseInLoop不能再handleClose，
+    // 否则会把已经remove的channel重新注册到poller上
+    setState(kDisConnected);
+    if (idleEntry_ != nullptr) {
+        idleWheel_->remove(idleEntry_);
+        idleEntry_ = nullptr;
+    }
+    if (reclaimEntry_ != nullptr) {
+        idleWheel_->remove(reclaimEntry_);
+        reclaimEntry_ = nullptr;
+    }
+    // 连接不再计入loop的统计
+    loop_->addBufferStats(-static_cast<int64_t>(accountedBytes_),
+                          -static_cast<int64_t>(accountedMemory_));
+    accountedBytes_ = accountedMemory_ = 0;
+    loop_->addConnectionCount(-1);
+    outputQueue_.clear();
+    queuedBytes_ = queuedFileBytes_ = 0;
+    if (!zeroCopyPending_.empty()) {
+        // 先把已经到达的完成通知读掉，剩下的交给loop继续等，不能在这里释放
+        handleZeroCopyCompletions();
+    }
+    if (!zeroCopyPending_.empty()) {
+        int fd = ::dup(channel_->fd());
+        if (fd < 0) {
+            LOG_ERROR("TcpConnection[%s] dup for zerocopy linger failed, "
+                      "errno=%d, leaking %zu pending sends \n",
+                      name().c_str(), errno, zeroCopyPending_.size());
+            new ZeroCopyPending(std::move(zeroCopyPending_));
+        } else {
+            // dup出来的fd让socket在Socket析构之后还活着，先在这里发出FIN
+            ::shutdown(fd, SHUT_WR);
+            std::shared_ptr<ZeroCopyLinger> linger(
+                new ZeroCopyLinger(loop_, fd, std::move(zeroCopyPending_)));
+            loop_->runAfter(linger->interval,
+                            std::bind(&TcpConnection::pollZeroCopyLinger,
+                                      linger));
+        }
+        zeroCopyPending_.clear();
+    }
+    if (readerPaused_) {
+        // 数据再也发不出去了，不要让被暂停的连接一直卡着
+        toggleThrottledReader();
+    }
+    hasThrottledReader_ = false;
+    if (chainedBuffers_) {
+        // 块都还给loop的池子，TcpConnection之后可能在别的线程析构
+        inputBuffer_.setBlockPool(nullptr);
+        outputBuffer_.setBlockPool(nullptr);
+    }
     channel_->remove(); //
 }
 
@@ -149,57 +545,237 @@ void TcpConnection::connectDestoryed() {
  * 应用写得快，而内核发送数据慢，需要把待发送数据写入缓冲区，而且设置了水位回调
  */
 void TcpConnection::sendInLoop(const void *data, size_t len) {
-    ssize_t nwrote = 0;
-    size_t remaining = len;
-    bool faultError = false;
-
     // 之前调用过该connection的shutdown，不能在进行发送了
     if (state_ == kDisConnected) {
         LOG_ERROR("disconnected, give up writing");
         return;
     }
 
-    // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
-        nwrote = ::write(channel_->fd(), data, len);
-        if (nwrote >= 0) {
-            remaining = len - nwrote;
-            if (remaining == 0 && writeCompleteCallback_) {
-                // 既然在这里 数据全部发送完成
-                // 就不用再给channel设置epollout事件了
-                loop_->queueInLoop(
-                    std::bind(writeCompleteCallback_, shared_from_this()));
-            }
-        } else { // nwrote < 0
-            nwrote = 0;
-            if (errno != EWOULDBLOCK) {
-                LOG_ERROR("TcpConnection::sendInLoop");
-                if (errno == EPIPE || errno == ECONNRESET) { // SIGPIPE REST
-                    faultError = true;
-                }
-            }
-        }
-    }
+    bool faultError = false;
+    size_t nwrote = writeDirectly(data, len, &faultError);
+    size_t remaining = len - nwrote;
 
     // 说明当前这一次write并没有把数据全部发送出去，剩余的数据需要保存到缓冲区当中，然后给channel注册EPOLLOUT事件，
     // poller发现tcp的发送缓冲区有空间，会通知相应的sock->channel,调用handleWrite回调方法
     // 也就是调用TcpConnection::handleWrite方法，把发送缓冲区的数据全部发送完成
     if (!faultError && remaining > 0) {
         // 目前发送缓冲区剩余的待发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
+        size_t oldLen = bufferedOutputBytes();
+        outputBuffer_.append((const char *)data + nwrote, remaining);
+        outputQueued(oldLen);
+    }
+}
 
-        if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ &&
-            highWaterMarkCallback_) {
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_,
-                                         shared_from_this(),
-                                         oldLen + remaining));
+// buf里的数据全部交给连接发送，buf被清空
+void TcpConnection::sendBufferInLoop(Buffer *buf) {
+    if (state_ == kDisConnected) {
+        LOG_ERROR("disconnected, give up writing");
+        buf->retrieveAll();
+        return;
+    }
+
+    if (zeroCopyEligible(buf->readableBytes()) && !buf->chained()) {
+        OutputSegment segment;
+        segment.buffer.reset(new Buffer(0));
+        segment.buffer->swap(*buf);
+        queueAndFlush(std::move(segment));
+        return;
+    }
+
+    bool faultError = false;
+    size_t nwrote =
+        writeDirectly(buf->peek(), buf->readableBytes(), &faultError);
+    buf->retrieve(nwrote);
+
+    if (!faultError && buf->readableBytes() > 0) {
+        size_t oldLen = bufferedOutputBytes();
+        if (oldLen == 0 && !outputBuffer_.chained() && !buf->chained()) {
+            // 输出缓冲区是空的，剩下的数据直接换进来，不拷贝
+            outputBuffer_.swap(*buf);
+        } else {
+            OutputSegment segment;
+            segment.buffer.reset(new Buffer(0));
+            segment.buffer->swap(*buf);
+            queueSegment(std::move(segment));
         }
-        outputBuffer_.append((char *)data + nwrote, remaining);
-        if (!channel_->isWriting()) {
-            // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
-            channel_->enableWriting();
+        outputQueued(oldLen);
+    }
+    buf->retrieveAll();
+}
+
+// 表示channel_第一次开始写数据，而且缓冲区没有待发送数据，先直接write
+// 返回写出去的字节数，对端已经断开时faultError置为true
+size_t TcpConnection::writeDirectly(const void *data, size_t len,
+                                    bool *faultError) {
+    if (outputPending() || len == 0) {
+        return 0;
+    }
+    if (autoCork_) {
+        // 先放进缓冲区，本轮结束时和后面的send一起写
+        scheduleCorkFlush();
+        return 0;
+    }
+
+    ssize_t nwrote = ::write(channel_->fd(), data, len);
+    if (nwrote >= 0) {
+        touchIdle();
+        if (static_cast<size_t>(nwrote) == len && writeCompleteCallback_) {
+            // 既然在这里 数据全部发送完成
+            // 就不用再给channel设置epollout事件了
+            loop_->queueInLoop(
+                std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+        return nwrote;
+    }
+
+    if (errno != EWOULDBLOCK) {
+        LOG_ERROR("TcpConnection::sendInLoop");
+        if (errno == EPIPE || errno == ECONNRESET) { // SIGPIPE REST
+            *faultError = true;
+        }
+    }
+    return 0;
+}
+
+// 数据段排到outputBuffer_已有的数据后面
+void TcpConnection::queueSegment(OutputSegment &&segment) {
+    if (outputBuffer_.readableBytes() > 0) {
+        // outputBuffer_里的数据要先发，把它整个换成一个数据段，不拷贝
+        OutputSegment sealed;
+        sealed.buffer.reset(new Buffer(0));
+        sealed.buffer->swap(outputBuffer_);
+        if (chainedBuffers_) {
+            outputBuffer_.setBlockPool(loop_->bufferPool());
         }
+        queuedBytes_ += sealed.size();
+        outputQueue_.push_back(std::move(sealed));
+    }
+    queuedBytes_ += segment.size();
+    if (segment.file) {
+        queuedFileBytes_ += segment.size();
+    }
+    outputQueue_.push_back(std::move(segment));
+}
+
+ssize_t TcpConnection::writeOutput(int *saveErrno) {
+    if (outputQueue_.empty()) {
+        return outputBuffer_.writeFd(channel_->fd(), saveErrno);
+    }
+
+    const OutputSegment &head = outputQueue_.front();
+    if (head.file) {
+        return sendFileRange(*head.file, saveErrno);
+    }
+    // 链式Buffer发送完的块会马上还给池子重用，不能交给内核直接引用
+    if (zeroCopyEligible(head.size()) &&
+        !(head.buffer && head.buffer->chained())) {
+        ssize_t n = sendZeroCopy(head, saveErrno);
+        if (n >= 0 || *saveErrno != ENOBUFS) {
+            return n;
+        }
+        // 内核给零拷贝用的optmem用完了，这一次退回普通的writev
+        *saveErrno = 0;
+    }
+
+    struct iovec vec[IOV_MAX];
+    int iovcnt = 0;
+    bool reachedFile = false;
+    for (const OutputSegment &segment : outputQueue_) {
+        if (iovcnt == IOV_MAX) {
+            break;
+        }
+        if (segment.file) {
+            // 文件区间只能用sendfile发送，这一次writev到它前面为止
+            reachedFile = true;
+            break;
+        }
+        if (segment.buffer) {
+            iovcnt += segment.buffer->readableIovecs(vec + iovcnt,
+                                                     IOV_MAX - iovcnt);
+        } else if (!segment.slice.empty()) {
+            vec[iovcnt].iov_base = const_cast<char *>(segment.slice.data());
+            vec[iovcnt].iov_len = segment.slice.size();
+            ++iovcnt;
+        }
+    }
+    if (!reachedFile) {
+        iovcnt += outputBuffer_.readableIovecs(vec + iovcnt, IOV_MAX - iovcnt);
+    }
+
+    ssize_t n = ::writev(channel_->fd(), vec, iovcnt);
+    if (n < 0) {
+        *saveErrno = errno;
+    }
+    return n;
+}
+
+// 队头是文件区间时调用，一次sendfile，偏移量由retrieveOutput推进
+ssize_t TcpConnection::sendFileRange(const FileRange &file, int *saveErrno) {
+    // sendfile一次最多发送0x7ffff000字节
+    const size_t kMaxSendFile = 0x7ffff000;
+    off_t offset = file.offset;
+    ssize_t n = ::sendfile(channel_->fd(), file.fd, &offset,
+                           std::min(file.length, kMaxSendFile));
+    if (n < 0) {
+        *saveErrno = errno;
+    } else if (n == 0) {
+        // 文件比指定的长度短，对端收到的数据已经不完整了，只能关闭连接
+        LOG_ERROR("TcpConnection[%s] sendFile fd=%d reached EOF with %zu bytes "
+                  "left \n",
+                  name().c_str(), file.fd, file.length);
+        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop,
+                                     shared_from_this()));
+    }
+    return n;
+}
+
+void TcpConnection::retrieveOutput(size_t n) {
+    while (n > 0 && !outputQueue_.empty()) {
+        OutputSegment &front = outputQueue_.front();
+        size_t size = front.size();
+        if (n >= size) {
+            n -= size;
+            queuedBytes_ -= size;
+            if (front.file) {
+                queuedFileBytes_ -= size;
+            }
+            outputQueue_.pop_front();
+        } else {
+            // 只发出去了一部分，剩下的留在队头
+            if (front.buffer) {
+                front.buffer->retrieve(n);
+            } else if (front.file) {
+                front.file->offset += n;
+                front.file->length -= n;
+                queuedFileBytes_ -= n;
+            } else {
+                front.slice = front.slice.slice(n, size - n);
+            }
+            queuedBytes_ -= n;
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        outputBuffer_.retrieve(n);
+    }
+}
+
+// 数据放进outputBuffer_或输出队列之后调用，oldLen是放进去之前待发送的长度
+void TcpConnection::outputQueued(size_t oldLen) {
+    size_t newLen = bufferedOutputBytes();
+    if (newLen >= highWaterMark_ && oldLen < highWaterMark_ &&
+        highWaterMarkCallback_) {
+        loop_->queueInLoop(
+            std::bind(highWaterMarkCallback_, shared_from_this(), newLen));
+    }
+    updateBackpressure();
+    if (!channel_->edgeTriggered() && !channel_->isWriting() &&
+        !corkFlushScheduled_) {
+        // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+        // 边沿触发模式下EPOLLOUT一直是注册着的，不需要再epoll_ctl
+        channel_->enableWriting();
     }
+    updateBufferStats();
 }
 
 void TcpConnection::shutdown() {
@@ -211,8 +787,421 @@ void TcpConnection::shutdown() {
 
 void TcpConnection::shutdownInLoop() {
     // 说明当前outputBuffer中的数据已经全部发送完成
-    if (!channel_->isWriting()) {
+    if (!outputPending()) {
         socket_->shutdownWrite(); //关闭写端
         
     }
 }
+
+void TcpConnection::forceClose() {
+    if (state_ == kConnected || state_ == kDisConnecting) {
+        setState(kDisConnecting);
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::startRead() {
+    loop_->runInLoop(std::bind(&TcpConnection::pauseReadInLoop,
+                               shared_from_this(), kReadPausedByUser, false));
+}
+
+void TcpConnection::stopRead() {
+    loop_->runInLoop(std::bind(&TcpConnection::pauseReadInLoop,
+                               shared_from_this(), kReadPausedByUser, true));
+}
+
+void TcpConnection::pauseReadInLoop(int reason, bool paused) {
+    if (state_ == kDisConnected) {
+        return;
+    }
+    const int oldPaused = readPaused_;
+    readPaused_ = paused ? (readPaused_ | reason) : (readPaused_ & ~reason);
+    if (readPaused_ != 0) {
+        if (channel_->isReading()) {
+            channel_->disableReading();
+        }
+    } else if (oldPaused != 0 || !channel_->isReading()) {
+        if (relaying()) {
+            // 转发模式下由flushRelay根据管道的情况决定什么时候注册EPOLLIN
+            resumeRelay();
+        } else {
+            channel_->enableReading();
+        }
+    }
+}
+
+void TcpConnection::setReadBackpressure(const TcpConnectionPtr &peer,
+                                        size_t lowWaterMark) {
+    std::weak_ptr<TcpConnection> reader(shared_from_this());
+    peer->loop_->runInLoop(std::bind(&TcpConnection::setThrottledReaderInLoop,
+                                     peer, reader, lowWaterMark));
+}
+
+void TcpConnection::setThrottledReaderInLoop(
+    const std::weak_ptr<TcpConnection> &reader, size_t lowWaterMark) {
+    if (readerPaused_) {
+        toggleThrottledReader(); // 先恢复之前被暂停的连接
+    }
+    throttledReader_ = reader;
+    hasThrottledReader_ = true;
+    lowWaterMark_ = lowWaterMark;
+    updateBackpressure();
+}
+
+void TcpConnection::toggleThrottledReader() {
+    readerPaused_ = !readerPaused_;
+    TcpConnectionPtr reader = throttledReader_.lock();
+    if (!reader) {
+        hasThrottledReader_ = readerPaused_ = false;
+        return;
+    }
+    LOG_DEBUG("TcpConnection[%s] %zu bytes pending, %s reading %s \n",
+              name().c_str(), bufferedOutputBytes(),
+              readerPaused_ ? "pause" : "resume", reader->name().c_str());
+    // 只动背压这一个暂停原因，应用自己的stopRead不受影响
+    reader->loop_->runInLoop(std::bind(&TcpConnection::pauseReadInLoop, reader,
+                                       kReadPausedByPeer, readerPaused_));
+}
+
+void TcpConnection::forceCloseInLoop() {
+    if (state_ == kConnected || state_ == kDisConnecting) {
+        // 和对端关闭连接一样处理，最终由TcpServer::removeConnection销毁
+        handleClose();
+    }
+}
+
+void TcpConnection::setIdleTimeout(int seconds) {
+    if (loop_->isInLoopThread()) {
+        setIdleTimeoutInLoop(seconds);
+    } else {
+        loop_->runInLoop(std::bind(&TcpConnection::setIdleTimeoutInLoop,
+                                   shared_from_this(), seconds));
+    }
+}
+
+void TcpConnection::setIdleTimeoutInLoop(int seconds) {
+    if (idleEntry_ != nullptr) {
+        idleWheel_->remove(idleEntry_);
+        idleEntry_ = nullptr;
+    }
+    if (seconds <= 0 || state_ == kDisConnected) {
+        return;
+    }
+
+    idleWheel_ = loop_->timingWheel();
+    // 时间轮只持有弱引用，连接已经销毁时什么都不做
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    idleWheel_->add(seconds,
+                    [weakConn]() {
+                        TcpConnectionPtr conn = weakConn.lock();
+                        if (conn) {
+                            LOG_INFO("TcpConnection[%s] idle timeout, force "
+                                     "close \n",
+                                     conn->name().c_str());
+                            conn->forceClose();
+                        }
+                    },
+                    &idleEntry_);
+}
+
+void TcpConnection::setBufferReclaimTimeout(int seconds) {
+    if (loop_->isInLoopThread()) {
+        setBufferReclaimTimeoutInLoop(seconds);
+    } else {
+        loop_->runInLoop(
+            std::bind(&TcpConnection::setBufferReclaimTimeoutInLoop,
+                      shared_from_this(), seconds));
+    }
+}
+
+void TcpConnection::setBufferReclaimTimeoutInLoop(int seconds) {
+    if (reclaimEntry_ != nullptr) {
+        idleWheel_->remove(reclaimEntry_);
+        reclaimEntry_ = nullptr;
+    }
+    if (seconds <= 0 || state_ == kDisConnected) {
+        return;
+    }
+
+    idleWheel_ = loop_->timingWheel();
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    idleWheel_->add(seconds,
+                    [weakConn]() {
+                        TcpConnectionPtr conn = weakConn.lock();
+                        if (conn) {
+                            conn->reclaimBuffers();
+                        }
+                    },
+                    &reclaimEntry_);
+}
+
+// 超时之后条目留在时间轮外面，直到下一次touchIdle才重新计时
+void TcpConnection::reclaimBuffers() {
+    inputBuffer_.shrink(Buffer::kInitialSize);
+    outputBuffer_.shrink(0);
+    updateBufferStats();
+    LOG_DEBUG("TcpConnection[%s] reclaim buffers, %zu bytes held \n",
+              name().c_str(), accountedMemory_);
+}
+
+void TcpConnection::updateBufferStats() {
+    size_t bytes = inputBuffer_.readableBytes() + bufferedOutputBytes();
+    size_t memory = inputBuffer_.capacity() + outputBuffer_.capacity();
+    if (bytes != accountedBytes_ || memory != accountedMemory_) {
+        loop_->addBufferStats(static_cast<int64_t>(bytes) -
+                                  static_cast<int64_t>(accountedBytes_),
+                              static_cast<int64_t>(memory) -
+                                  static_cast<int64_t>(accountedMemory_));
+        accountedBytes_ = bytes;
+        accountedMemory_ = memory;
+    }
+}
+
+bool TcpConnection::relayTo(const TcpConnectionPtr &peer) {
+    if (!loop_->isInLoopThread() || peer->getLoop() != loop_ ||
+        peer.get() == this || relaying()) {
+        LOG_ERROR("TcpConnection[%s] cannot relay to %s \n", name().c_str(),
+                  peer->name().c_str());
+        return false;
+    }
+    if (::pipe2(relayPipe_, O_NONBLOCK | O_CLOEXEC) < 0) {
+        LOG_ERROR("TcpConnection[%s] relay pipe2 errno=%d \n", name().c_str(),
+                  errno);
+        relayPipe_[0] = relayPipe_[1] = -1;
+        return false;
+    }
+    // 管道越大，一次splice能搬的数据越多；设置失败就用默认的64K
+    ::fcntl(relayPipe_[1], F_SETPIPE_SZ, kRelayPipeSize);
+
+    relayTarget_ = peer;
+    peer->relaySource_ = shared_from_this();
+    if (inputBuffer_.readableBytes() > 0) {
+        // 开始转发之前已经读进来的数据
+        peer->send(&inputBuffer_);
+    }
+    if (state_ == kConnected) {
+        handleRelayRead();
+    }
+    return true;
+}
+
+void TcpConnection::handleRelayRead() {
+    while (!relayEof_) {
+        ssize_t n = ::splice(channel_->fd(), nullptr, relayPipe_[1], nullptr,
+                             kRelayPipeSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            touchIdle();
+            relayPipeBytes_ += n;
+            if (!flushRelay()) {
+                return; // 对端发不动了
+            }
+        } else if (n == 0) {
+            relayEof_ = true;
+            if (!channel_->edgeTriggered()) {
+                channel_->disableReading();
+            }
+            flushRelay();
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("TcpConnection::handleRelayRead");
+                handleError();
+                forceCloseInLoop();
+            }
+            return;
+        }
+    }
+}
+
+bool TcpConnection::flushRelay() {
+    TcpConnectionPtr target = relayTarget_.lock();
+    if (!target || target->state_ == kDisConnected) {
+        forceCloseInLoop();
+        return false;
+    }
+
+    // 对端自己的输出队列还没发完，等它发完了再接着发管道里的数据，保证顺序
+    while (relayPipeBytes_ > 0 && target->pendingOutputBytes() == 0) {
+        ssize_t n = ::splice(relayPipe_[0], nullptr, target->channel_->fd(),
+                             nullptr, relayPipeBytes_,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            target->touchIdle();
+            relayPipeBytes_ -= n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            LOG_ERROR("TcpConnection[%s] relay to %s failed \n", name().c_str(),
+                      target->name().c_str());
+            target->forceCloseInLoop();
+            forceCloseInLoop();
+            return false;
+        }
+    }
+
+    Channel *targetChannel = target->channel_.get();
+    if (relayPipeBytes_ > 0) {
+        // 背压：先不读这一边，等对端的EPOLLOUT
+        if (!channel_->edgeTriggered() && channel_->isReading()) {
+            channel_->disableReading();
+        }
+        if (!targetChannel->edgeTriggered() && !targetChannel->isWriting()) {
+            targetChannel->enableWriting();
+        }
+        return false;
+    }
+
+    if (!targetChannel->edgeTriggered() && targetChannel->isWriting() &&
+        target->pendingOutputBytes() == 0) {
+        targetChannel->disableWriting();
+    }
+    if (relayEof_) {
+        finishRelay(target);
+        return false;
+    }
+    if (readPaused_ == 0 && !channel_->isReading()) {
+        channel_->enableReading(); // stopRead或者背压暂停期间不恢复
+    }
+    return true;
+}
+
+void TcpConnection::resumeRelay() {
+    if (!relaying() || relayFinished_) {
+        return;
+    }
+    if (flushRelay() && channel_->edgeTriggered() && readPaused_ == 0) {
+        // 边沿触发不会再通知一次，暂停期间到达的数据要主动读
+        handleRelayRead();
+    }
+}
+
+// 这个方向读到EOF并且数据都发出去了，把半关闭传给对端
+void TcpConnection::finishRelay(const TcpConnectionPtr &target) {
+    if (relayFinished_) {
+        return;
+    }
+    relayFinished_ = true;
+    target->shutdown();
+
+    TcpConnectionPtr reverse = relaySource_.lock();
+    if (!reverse) {
+        // 单向转发，这一边已经没有数据了
+        forceCloseInLoop();
+    } else if (reverse->relayFinished_) {
+        // 两个方向都结束了
+        forceCloseInLoop();
+        reverse->forceCloseInLoop();
+    }
+}
+
+void TcpConnection::setZeroCopyThreshold(size_t threshold) {
+    if (threshold > 0) {
+        int on = 1;
+        if (::setsockopt(channel_->fd(), SOL_SOCKET, SO_ZEROCOPY, &on,
+                         sizeof on) < 0) {
+            LOG_ERROR("TcpConnection[%s] SO_ZEROCOPY not supported, errno=%d \n",
+                      name().c_str(), errno);
+            return;
+        }
+    }
+    zeroCopyThreshold_ = threshold;
+}
+
+ssize_t TcpConnection::sendZeroCopy(const OutputSegment &segment,
+                                    int *saveErrno) {
+    struct iovec vec[64];
+    int iovcnt = 0;
+    if (segment.buffer) {
+        iovcnt = segment.buffer->readableIovecs(vec, 64);
+    } else {
+        vec[0].iov_base = const_cast<char *>(segment.slice.data());
+        vec[0].iov_len = segment.slice.size();
+        iovcnt = 1;
+    }
+
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = iovcnt;
+    ssize_t n = ::sendmsg(channel_->fd(), &msg, MSG_ZEROCOPY);
+    if (n < 0) {
+        *saveErrno = errno;
+        return n;
+    }
+    // 每次成功的MSG_ZEROCOPY发送占用一个通知序号，哪怕只发出去了一部分
+    // 拷贝一份数据段持有内存的引用，retrieveOutput裁剪队头不影响这里
+    zeroCopyPending_.push_back(std::make_pair(zeroCopyNextId_++, segment));
+    ++zeroCopySends_;
+    return n;
+}
+
+bool TcpConnection::handleZeroCopyCompletions() {
+    const uint64_t copiedBefore = zeroCopyCopied_;
+    bool notified = drainZeroCopyCompletions(channel_->fd(), &zeroCopyPending_,
+                                             &zeroCopyCopied_);
+    if (zeroCopyCopied_ != copiedBefore && zeroCopyThreshold_ > 0) {
+        // 内核还是拷贝了数据，零拷贝只剩下通知的开销，退回普通发送
+        LOG_DEBUG("TcpConnection[%s] zerocopy sends were copied, "
+                  "fall back to copying sends \n",
+                  name().c_str());
+        zeroCopyThreshold_ = 0;
+    }
+    return notified;
+}
+
+bool TcpConnection::drainZeroCopyCompletions(int fd, ZeroCopyPending *pending,
+                                             uint64_t *copied) {
+    bool notified = false;
+    for (;;) {
+        char control[128];
+        struct msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+            break; // 错误队列读完了
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 &&
+                  cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            const struct sock_extended_err *serr =
+                reinterpret_cast<const struct sock_extended_err *>(
+                    CMSG_DATA(cm));
+            if (serr->ee_errno != 0 ||
+                serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            notified = true;
+
+            // 通知的是序号区间[ee_info, ee_data]，区间按顺序到达
+            const uint32_t hi = serr->ee_data;
+            const uint32_t count = hi - serr->ee_info + 1;
+            while (!pending->empty() &&
+                   static_cast<int32_t>(pending->front().first - hi) <= 0) {
+                pending->pop_front();
+            }
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                *copied += count;
+            }
+        }
+    }
+    return notified;
+}
+
+void TcpConnection::pollZeroCopyLinger(
+    const std::shared_ptr<ZeroCopyLinger> &linger) {
+    drainZeroCopyCompletions(linger->fd, &linger->pending, &linger->copied);
+    if (linger->pending.empty() || linger->deadline < Timestamp::now()) {
+        return; // 最后一个引用随定时器回调一起释放
+    }
+    linger->interval =
+        std::min(linger->interval * 2, ZeroCopyLinger::kMaxInterval);
+    linger->loop->runAfter(linger->interval,
+                           std::bind(&TcpConnection::pollZeroCopyLinger,
+                                     linger));
+}
@@ -3,12 +3,18 @@
 #include "Buffer.h"
 #include "Callbacks.h"
 #include "InetAddress.h"
+#include "SharedSlice.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
 #include "noncopyable.h"
 
 #include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <stdint.h>
 #include <string>
+#include <sys/types.h>
 
 class Channel;
 class EventLoop;
@@ -22,19 +28,76 @@ class TcpConnection : noncopyable,
 public:
     TcpConnection(EventLoop *loop, const std::string &name, int sockfd,
                   const InetAddress &loaclAddr, const InetAddress &peerAddr);
+    // TcpServer使用：名字是namePrefix#id，第一次调用name()时才拼出来
+    TcpConnection(EventLoop *loop, uint64_t id,
+                  std::shared_ptr<const std::string> namePrefix, int sockfd,
+                  const InetAddress &loaclAddr, const InetAddress &peerAddr);
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    // TcpServer分配的连接编号，不经过TcpServer创建的连接为0
+    uint64_t id() const { return id_; }
+    const std::string &name() const;
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
 
-    // 发送数据
+    // 发送数据，都是线程安全的，在其他线程调用时数据的所有权交给loop线程
+    // 不在loop线程调用时要拷贝一份buf
     void send(const std::string &buf);
+    // 移动进来，不拷贝数据
+    void send(std::string &&buf);
+    // 发送buf中所有可读的数据，buf被清空；内容是换进来的，不拷贝数据
+    void send(Buffer *buf);
+    // 只增加引用计数，同一份数据可以发给多个连接
+    void send(const SharedSlice &slice);
+    // 用sendfile发送文件fd中[offset, offset + length)的内容，数据不经过用户态
+    // 和其他send的数据按调用顺序发送，全部发完后回调writeCompleteCallback_
+    // 内部会dup一份fd，调用之后就可以关闭fd
+    void sendFile(int fd, off_t offset, size_t length);
+
+    // 把这个连接收到的数据经过一对管道用splice直接转发给peer，不经过用户态，
+    // 之后不再回调messageCallback_；inputBuffer_里已有的数据会先发给peer
+    // peer发不动时暂停读这一边（背压），读到EOF后等管道里的数据发完再shutdown peer
+    // 两个方向都调用就是一个完整的代理，两个方向都结束后两边一起关闭；
+    // 只有单向转发时，读完数据就关闭这一边
+    // 两个连接必须属于同一个loop，只能在loop线程、connectEstablished之后调用
+    bool relayTo(const TcpConnectionPtr &peer);
+
+    // 不小于threshold字节、数据由连接持有的发送（移动进来的字符串、SharedSlice、
+    // send(Buffer*)）使用MSG_ZEROCOPY，内核直接引用这些内存，
+    // 错误队列通知发送完成之后才释放；threshold为0表示关闭，内核不支持时保持关闭
+    // 内核通知数据其实被拷贝过（比如回环地址）之后，这个连接退回普通发送
+    // 只能在connectEstablished之前或者loop线程调用
+    void setZeroCopyThreshold(size_t threshold);
+    // 用MSG_ZEROCOPY发送的次数 / 其中被内核拷贝过的次数
+    uint64_t zeroCopySends() const { return zeroCopySends_; }
+    uint64_t zeroCopyCopied() const { return zeroCopyCopied_; }
     // 关闭连接
     void shutdown();
+    // 不等待输出缓冲区发送完，直接关闭连接
+    void forceClose();
+
+    // 暂停/恢复读数据（注销/注册EPOLLIN），线程安全
+    // 应用处理不过来时先停止读，数据留在内核的接收缓冲区里，由TCP的窗口去限制对端
+    void startRead();
+    void stopRead();
+    // 应用自己有没有暂停读，不反映自动背压的暂停
+    bool isReading() const { return !(readPaused_ & kReadPausedByUser); }
+    // 是否正被自动背压暂停读
+    bool isReadThrottled() const { return readPaused_ & kReadPausedByPeer; }
+
+    // 自动背压：peer待发送的数据超过peer的highWaterMark_时暂停读this，
+    // 降到lowWaterMark以下时恢复；peer可以是this自己（比如echo，发不出去就先别读了），
+    // 也可以是this收到的数据要转发过去的另一个连接，可以不在同一个loop
+    // 一个peer只记录一个被限制的连接，后设置的覆盖先设置的
+    // 和startRead/stopRead互不影响：两边都没有暂停时才恢复读
+    void setReadBackpressure(const TcpConnectionPtr &peer, size_t lowWaterMark);
+
+    // 连续seconds秒没有读写就强制关闭连接，seconds <= 0 表示关闭空闲检测
+    // 由所属loop的时间轮驱动，读写时只更新活跃时间
+    void setIdleTimeout(int seconds);
 
     void setConnectionCallback(const ConnectionCallback &cb) {
         connectionCallback_ = cb;
@@ -56,6 +119,26 @@ public:
 
     void setCloseCallback(const CloseCallback &cb) { closeCallback_ = cb; }
 
+    // 只修改高水位，不设置回调
+    void setHighWaterMark(size_t highWaterMark) {
+        highWaterMark_ = highWaterMark;
+    }
+
+    // 使用边沿触发模式，只能在connectEstablished之前调用
+    void setEdgeTriggered(bool on);
+
+    // 输入输出缓冲区使用loop的BufferPool做链式存储，只能在connectEstablished之前调用
+    void setChainedBuffers(bool on) { chainedBuffers_ = on; }
+
+    // 自动合并写：loop线程里的send只放进缓冲区，本轮事件和回调处理完之后统一写一次
+    // 一次回调里多次send的流水线协议可以少很多write和小包，代价是要等到本轮结束才发送
+    // 只能在connectEstablished之前或者loop线程调用
+    void setAutoCork(bool on) { autoCork_ = on; }
+
+    // 连续seconds秒没有读写时，把输入输出缓冲区收缩到初始大小，<=0表示关闭
+    // 长连接偶尔收发一次大消息之后，缓冲区不会一直保持峰值大小
+    void setBufferReclaimTimeout(int seconds);
+
     // 连接建立
     void connectEstablished();
     // 连接销毁
@@ -63,21 +146,140 @@ public:
 
 private:
     enum State { kDisConnected, kConnecting, kConnected, kDisConnecting };
+    // 暂停读的原因，可以同时存在
+    enum ReadPauseReason {
+        kReadPausedByUser = 1, // stopRead
+        kReadPausedByPeer = 2, // 自动背压
+    };
     void handleRead(Timestamp receiveTime);
+    void handleReadEdgeTriggered(ssize_t n, int saveErrno,
+                                 Timestamp receiveTime);
     void handleWrite();
+    // 写出待发送的数据，untilBlocked为true时一直写到EAGAIN，否则只写一次
+    void flushOutput(bool untilBlocked);
+    void flushCorked();
+    // 登记本轮结束时的合并写，每轮最多登记一次
+    void scheduleCorkFlush();
     void handleClose();
     void handleError();
 
     void setState(State state) { state_ = state; }
 
+    // 还有数据在等待发送（输出缓冲区非空，或者正在等待EPOLLOUT）
+    bool outputPending() const;
+
+    // sendFile要发送的文件区间，持有dup出来的fd，析构时关闭
+    struct FileRange : noncopyable {
+        int fd;
+        off_t offset;
+        size_t length;
+
+        FileRange(int fd, off_t offset, size_t length)
+            : fd(fd), offset(offset), length(length) {}
+        ~FileRange();
+    };
+
+    // 输出队列中的一段数据，buffer和file都为空时使用slice
+    struct OutputSegment {
+        std::shared_ptr<Buffer> buffer;
+        std::shared_ptr<FileRange> file;
+        SharedSlice slice;
+
+        size_t size() const {
+            if (buffer) {
+                return buffer->readableBytes();
+            }
+            return file ? file->length : slice.size();
+        }
+    };
+
     void sendInLoop(const void *message, size_t len);
+    void sendStringInLoop(std::string &message);
+    void sendSliceInLoop(const SharedSlice &slice);
+    void sendBufferInLoop(Buffer *buf);
+    void sendFileInLoop(const std::shared_ptr<FileRange> &file);
+    void queueAndFlush(OutputSegment &&segment);
+    bool zeroCopyEligible(size_t len) const {
+        return zeroCopyThreshold_ > 0 && len >= zeroCopyThreshold_;
+    }
+    ssize_t sendZeroCopy(const OutputSegment &segment, int *saveErrno);
+    // 已经用MSG_ZEROCOPY发出去、内核还没有通知完成的数据和它们的通知序号
+    using ZeroCopyPending = std::deque<std::pair<uint32_t, OutputSegment>>;
+    // 读错误队列里的MSG_ZEROCOPY完成通知，读到了返回true
+    bool handleZeroCopyCompletions();
+    // 读完fd错误队列里的完成通知，释放已经完成的数据，copied累加内核拷贝了的发送次数
+    static bool drainZeroCopyCompletions(int fd, ZeroCopyPending *pending,
+                                         uint64_t *copied);
+    // 连接销毁时还有没完成的零拷贝发送，由loop接着等完成通知，见TcpConnection.cc
+    struct ZeroCopyLinger;
+    static void pollZeroCopyLinger(const std::shared_ptr<ZeroCopyLinger> &linger);
+    size_t writeDirectly(const void *data, size_t len, bool *faultError);
+    void queueSegment(OutputSegment &&segment);
+    void outputQueued(size_t oldLen);
+    // 输出队列和outputBuffer_中所有待发送的字节数
+    size_t pendingOutputBytes() const {
+        return queuedBytes_ + outputBuffer_.readableBytes();
+    }
+    // 待发送数据中占用内存的部分（不算文件区间），高水位按这个计算
+    size_t bufferedOutputBytes() const {
+        return pendingOutputBytes() - queuedFileBytes_;
+    }
+    // 用一次writev发送输出队列和outputBuffer_中的数据
+    ssize_t writeOutput(int *saveErrno);
+    ssize_t sendFileRange(const FileRange &file, int *saveErrno);
+    // 丢掉已经发送出去的n个字节，可能跨越多个数据段
+    void retrieveOutput(size_t n);
     void shutdownInLoop();
+    void forceCloseInLoop();
+    // 设置或清除一个暂停原因，所有原因都清除了才注册EPOLLIN
+    void pauseReadInLoop(int reason, bool paused);
+    void setThrottledReaderInLoop(const std::weak_ptr<TcpConnection> &reader,
+                                  size_t lowWaterMark);
+    // 待发送的数据量变化之后，按高低水位暂停或者恢复throttledReader_
+    void updateBackpressure() {
+        if (hasThrottledReader_) {
+            size_t pending = bufferedOutputBytes();
+            if (readerPaused_ ? pending <= lowWaterMark_
+                              : pending >= highWaterMark_) {
+                toggleThrottledReader();
+            }
+        }
+    }
+    void toggleThrottledReader();
+    void setIdleTimeoutInLoop(int seconds);
+    void setBufferReclaimTimeoutInLoop(int seconds);
+    void touchIdle() {
+        if (idleEntry_ != nullptr) {
+            idleWheel_->touch(idleEntry_);
+        }
+        if (reclaimEntry_ != nullptr) {
+            // 回收过之后条目已经不在时间轮上，有活动时重新开始计时
+            idleWheel_->restart(reclaimEntry_);
+        }
+    }
+    void reclaimBuffers();
+
+    // 转发管道的大小
+    static const int kRelayPipeSize = 1024 * 1024;
+
+    bool relaying() const { return relayPipe_[0] >= 0; }
+    void handleRelayRead();
+    // 把管道里的数据发给relayTarget_，全部发完返回true
+    bool flushRelay();
+    // relayTarget_又可以写了，继续转发
+    void resumeRelay();
+    void finishRelay(const TcpConnectionPtr &target);
+    // 把缓冲区大小的变化同步到loop的统计
+    void updateBufferStats();
 
     EventLoop *
         loop_; // 这里绝对不是baseLoop，因为TcpConnection都是在subLoop里面管理的
-    const std::string name_;
+    const uint64_t id_;
+    const std::shared_ptr<const std::string> namePrefix_;
+    mutable std::once_flag nameOnce_;
+    mutable std::string name_;
     std::atomic_int state_;
-    bool reading_;
+    int readPaused_; // ReadPauseReason的组合，为0时才读
 
     // 这里和Acceptor类似 accpetor在mainloop里 tcpConnection在subloop里
     std::unique_ptr<Socket> socket_;
@@ -93,6 +295,42 @@ private:
     CloseCallback closeCallback_;
     size_t highWaterMark_;
 
+    // 输出积压时被暂停读的连接，见setReadBackpressure
+    std::weak_ptr<TcpConnection> throttledReader_;
+    bool hasThrottledReader_;
+    bool readerPaused_;
+    size_t lowWaterMark_;
+
     Buffer inputBuffer_;    // 接收数据的缓冲区
     Buffer outputBuffer_;   // 发送数据的缓冲区
+    // 排在outputBuffer_之前等待发送的数据段，移动进来的字符串、共享的slice等
+    // 发送时和outputBuffer_一起writev，不会拷贝到outputBuffer_里
+    std::deque<OutputSegment> outputQueue_;
+    size_t queuedBytes_;     // outputQueue_中的字节数
+    size_t queuedFileBytes_; // 其中文件区间的字节数
+
+    // splice转发：数据从这个连接经过relayPipe_流向relayTarget_
+    std::weak_ptr<TcpConnection> relayTarget_;
+    std::weak_ptr<TcpConnection> relaySource_; // 往这个连接转发数据的一方
+    int relayPipe_[2];
+    size_t relayPipeBytes_; // 管道里还没有发给relayTarget_的字节数
+    bool relayEof_;         // 已经读到EOF
+    bool relayFinished_;    // 读到EOF并且管道已经排空，relayTarget_已经shutdown
+
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopyNextId_; // 下一次MSG_ZEROCOPY发送的通知序号，内核从0开始计数
+    // 内核还引用着这些内存，完成之前必须保持有效，连接销毁时交给ZeroCopyLinger
+    ZeroCopyPending zeroCopyPending_;
+    uint64_t zeroCopySends_;
+    uint64_t zeroCopyCopied_;
+
+    TimingWheel *idleWheel_;        // loop_的时间轮
+    TimingWheel::Entry *idleEntry_; // 空闲检测在时间轮上的条目，由时间轮持有
+    TimingWheel::Entry *reclaimEntry_; // 缓冲区内存回收的条目
+    bool chainedBuffers_;           // 缓冲区使用loop的BufferPool
+    bool autoCork_;
+    bool corkFlushScheduled_;       // 已经登记了本轮结束时的合并写
+    // 上一次同步到loop统计里的数值
+    size_t accountedBytes_;
+    size_t accountedMemory_;
 };
\ No newline at end of file
@@ -2,8 +2,17 @@
 #include "Logger.h"
 #include "TcpConnection.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <errno.h>
 #include <functional>
+#include <mutex>
+#include <poll.h>
+#include <string.h>
 #include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop) {
     if (loop == nullptr) {
@@ -13,29 +22,104 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop) {
     return loop;
 }
 
+// 监听socket绑定的本地地址
+static InetAddress listenAddressOf(const std::vector<int> &listenFds) {
+    if (listenFds.empty()) {
+        LOG_FATAL("%s:%s:%d no listen socket to adopt \n", __FILE__,
+                  __FUNCTION__, __LINE__);
+    }
+    sockaddr_in local;
+    ::bzero(&local, sizeof local);
+    socklen_t addrlen = sizeof local;
+    if (::getsockname(listenFds[0], (sockaddr *)&local, &addrlen) < 0) {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    return InetAddress(local);
+}
+
+// TcpServer析构之后连接上再触发的关闭回调，不能再访问TcpServer
+static void detachedCloseCallback(const TcpConnectionPtr &) {}
+
+// kReusePortPerLoop模式下所有继承来的socket都在start时分给各个loop
+static Acceptor *adoptAcceptor(EventLoop *loop,
+                               const std::vector<int> &listenFds,
+                               TcpServer::Option option) {
+    if (option == TcpServer::kReusePortPerLoop || listenFds.empty()) {
+        return nullptr;
+    }
+    return new Acceptor(loop, listenFds[0]);
+}
+
 TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr,
                      const std::string &nameArg, Option option)
-    : loop_(CheckLoopNotNull(loop)), ipPort_(listenAddr.toIpPort()),
-      name_(nameArg),
-      acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
+    : TcpServer(loop, listenAddr, nameArg, option,
+                new Acceptor(loop, listenAddr, option != kNoReusePort)) {}
+
+TcpServer::TcpServer(EventLoop *loop, const std::vector<int> &listenFds,
+                     const std::string &nameArg, Option option)
+    : TcpServer(loop, listenAddressOf(listenFds), nameArg, option,
+                adoptAcceptor(loop, listenFds, option)) {
+    inheritedFds_.assign(acceptor_ ? listenFds.begin() + 1 : listenFds.begin(),
+                         listenFds.end());
+}
+
+TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr,
+                     const std::string &nameArg, Option option,
+                     Acceptor *acceptor)
+    : loop_(CheckLoopNotNull(loop)), listenAddr_(listenAddr),
+      ipPort_(listenAddr.toIpPort()), name_(nameArg), option_(option),
+      connNamePrefix_(std::make_shared<const std::string>(name_ + "-" +
+                                                          ipPort_)),
+      acceptor_(acceptor),
       threadPool_(new EventLoopThreadPool(loop, name_)), connectionCallback_(),
-      messageCallback_(), nextConnId_(),started_(0) {
+      messageCallback_(), started_(0),
+      edgeTriggered_(false), chainedBuffers_(false),
+      bufferReclaimSeconds_(0), zeroCopyThreshold_(0), autoCork_(false),
+      readBackpressure_(false), backpressureHighWaterMark_(0),
+      backpressureLowWaterMark_(0), nextConnId_(0), numConnections_(0),
+      acceptingStopped_(false), acceptorStopsPending_(0), draining_(false),
+      drainForced_(false) {
     // 当有新用户连接时，会执行TcpServer::newConnection
-    acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection,
-                                                  this, std::placeholders::_1,
-                                                  std::placeholders::_2));
+    if (acceptor_) {
+        acceptor_->setNewConnectionCallback(std::bind(
+            &TcpServer::newConnection, this, std::placeholders::_1,
+            std::placeholders::_2));
+    }
 }
 
 TcpServer::~TcpServer() {
-    for (auto &item : connections_) {
-        // 这个局部的shared_ptr智能指针对象，出了作用域，可以自动释放new出来的TcpConnection资源
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();
+    if (draining_) {
+        loop_->cancel(drainTimer_);
+    }
+    acceptor_.reset();
+    destroyLoopAcceptors(loop_);
+    for (int fd : inheritedFds_) {
+        ::close(fd);
+    }
 
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestoryed,conn)
-        );
+    // subLoop的Acceptor和分片都要在自己的loop线程里销毁，等所有loop都处理完再返回，
+    // 否则subLoop上新accept的连接会用到已经析构了一半的TcpServer
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t remaining = shards_.size();
+    for (const ConnectionShardPtr &shard : shards_) {
+        ConnectionShardPtr s(shard);
+        s->loop->runInLoop([this, s, &mutex, &cond, &remaining]() {
+            destroyLoopAcceptors(s->loop);
+            for (auto &item : s->connections) {
+                item.second->setCloseCallback(detachedCloseCallback);
+                item.second->connectDestoryed();
+            }
+            s->connections.clear();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            --remaining;
+            cond.notify_all();
+        });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    while (remaining > 0) {
+        cond.wait(lock);
     }
 }
 
@@ -46,21 +130,301 @@ void TcpServer::setThreadNum(int numThreads) {
 void TcpServer::start() {
     if (started_++ == 0) { // 防止一个TcpServer对象被start多次
         threadPool_->start(threadInitCallBack_); // 启动底层线程池
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+        for (EventLoop *ioLoop : loops) {
+            ConnectionShardPtr shard(new ConnectionShard);
+            shard->loop = ioLoop;
+            shards_.push_back(shard);
+        }
+        if (option_ != kReusePortPerLoop ||
+            (acceptor_ && loops.front() == loop_)) {
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+            // 继承来的其他监听socket也在baseLoop上accept，队列里的连接不能丢
+            for (int fd : inheritedFds_) {
+                addLoopAcceptor(loop_, new Acceptor(loop_, fd));
+            }
+            inheritedFds_.clear();
+            return;
+        }
+        // 每个subLoop各自listen，baseLoop的acceptor_只绑定地址，不参与accept
+        // 继承来的socket依次分给各个loop，比loop多时一个loop可以有多个Acceptor
+        size_t n = std::max(loops.size(), inheritedFds_.size());
+        for (size_t i = 0; i < n; ++i) {
+            EventLoop *ioLoop = loops[i % loops.size()];
+            addLoopAcceptor(ioLoop,
+                            i < inheritedFds_.size()
+                                ? new Acceptor(ioLoop, inheritedFds_[i])
+                                : new Acceptor(ioLoop, listenAddr_, true));
+        }
+        inheritedFds_.clear();
+    }
+}
+
+void TcpServer::addLoopAcceptor(EventLoop *ioLoop, Acceptor *acceptor) {
+    acceptor->setNewConnectionCallback(
+        std::bind(&TcpServer::newConnectionInLoop, this, ioLoop,
+                  std::placeholders::_1, std::placeholders::_2));
+    loopAcceptors_.push_back(std::unique_ptr<Acceptor>(acceptor));
+    loopAcceptorLoops_.push_back(ioLoop);
+    ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+}
+
+// 每个loop只重置自己的元素，loopAcceptors_在start之后不会再增删，不需要加锁
+void TcpServer::destroyLoopAcceptors(EventLoop *loop) {
+    for (size_t i = 0; i < loopAcceptors_.size(); ++i) {
+        if (loopAcceptorLoops_[i] == loop) {
+            loopAcceptors_[i].reset();
+        }
+    }
+}
+
+void TcpServer::stopAccepting() {
+    loop_->runInLoop(std::bind(&TcpServer::stopAcceptingInLoop, this));
+}
+
+// Acceptor析构时关闭监听fd
+// Acceptor的channel注册在各自loop的poller上，要回到那个loop线程里析构
+void TcpServer::stopAcceptingInLoop() {
+    if (acceptingStopped_) {
+        return;
+    }
+    acceptingStopped_ = true;
+    acceptor_.reset();
+    destroyLoopAcceptors(loop_);
+    acceptorStopsPending_ = shards_.size();
+    for (const ConnectionShardPtr &shard : shards_) {
+        shard->loop->runInLoop(
+            std::bind(&TcpServer::stopLoopAccepting, this, shard->loop));
+    }
+}
+
+// baseLoop之前转交给这个loop的连接都已经登记过了，这个loop自己也不会再accept，
+// 之后numConnections_只会减少
+void TcpServer::stopLoopAccepting(EventLoop *loop) {
+    destroyLoopAcceptors(loop);
+    --acceptorStopsPending_;
+}
+
+void TcpServer::drain(double timeoutSeconds, const DrainCallback &cb) {
+    loop_->runInLoop(
+        std::bind(&TcpServer::drainInLoop, this, timeoutSeconds, cb));
+}
+
+void TcpServer::drainInLoop(double timeoutSeconds, const DrainCallback &cb) {
+    stopAcceptingInLoop();
+    if (draining_) {
+        drainCallback_ = cb;
+        return;
+    }
+    draining_ = true;
+    drainForced_ = false;
+    drainCallback_ = cb;
+    drainDeadline_ = addTime(Timestamp::now(), timeoutSeconds);
+    // shutdown会等输出缓冲区发完再关闭写端
+    forEachConnection(&TcpConnection::shutdown);
+    drainTimer_ = loop_->runEvery(kDrainCheckInterval,
+                                  std::bind(&TcpServer::checkDrain, this));
+    checkDrain();
+}
+
+void TcpServer::checkDrain() {
+    if (!draining_) {
+        return;
     }
+    // 所有loop都确认停止accept之前，连接数为0不代表已经没有连接了
+    if (acceptorStopsPending_ == 0 && numConnections_ == 0) {
+        draining_ = false;
+        loop_->cancel(drainTimer_);
+        if (drainCallback_) {
+            DrainCallback cb;
+            cb.swap(drainCallback_);
+            cb();
+        }
+        return;
+    }
+    if (!drainForced_ && !(Timestamp::now() < drainDeadline_)) {
+        LOG_INFO("TcpServer::drain [%s] - deadline reached, force closing %zu "
+                 "connections \n",
+                 name_.c_str(), static_cast<size_t>(numConnections_));
+        drainForced_ = true;
+        forEachConnection(&TcpConnection::forceClose);
+    }
+}
+
+void TcpServer::forEachConnection(void (TcpConnection::*fn)()) {
+    for (const ConnectionShardPtr &shard : shards_) {
+        ConnectionShardPtr s(shard);
+        s->loop->runInLoop([s, fn]() {
+            for (auto &item : s->connections) {
+                (item.second.get()->*fn)();
+            }
+        });
+    }
+}
+
+bool TcpServer::handOffListenSockets(const std::string &unixPath) {
+    if (acceptingStopped_) {
+        // subLoop可能正在销毁自己的Acceptor，监听socket已经关闭了
+        LOG_ERROR("TcpServer::handOffListenSockets [%s] - already stopped "
+                  "accepting \n",
+                  name_.c_str());
+        return false;
+    }
+    std::vector<int> fds;
+    if (acceptor_ && acceptor_->listenning()) {
+        fds.push_back(acceptor_->fd());
+    }
+    for (const std::unique_ptr<Acceptor> &acceptor : loopAcceptors_) {
+        fds.push_back(acceptor->fd());
+    }
+    if (fds.empty() || fds.size() > kMaxHandOffFds) {
+        LOG_ERROR("TcpServer::handOffListenSockets [%s] - %zu sockets \n",
+                  name_.c_str(), fds.size());
+        return false;
+    }
+
+    sockaddr_un addr;
+    ::bzero(&addr, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (unixPath.size() >= sizeof addr.sun_path) {
+        LOG_ERROR("TcpServer::handOffListenSockets path too long: %s \n",
+                  unixPath.c_str());
+        return false;
+    }
+    ::strncpy(addr.sun_path, unixPath.c_str(), sizeof addr.sun_path - 1);
+
+    int sockfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        LOG_ERROR("TcpServer::handOffListenSockets socket errno=%d \n", errno);
+        return false;
+    }
+    if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) < 0) {
+        LOG_ERROR("TcpServer::handOffListenSockets connect %s errno=%d \n",
+                  unixPath.c_str(), errno);
+        ::close(sockfd);
+        return false;
+    }
+
+    // 至少要带一个字节的普通数据，控制信息才会被发送
+    char one = 'L';
+    struct iovec vec;
+    vec.iov_base = &one;
+    vec.iov_len = 1;
+    char control[CMSG_SPACE(sizeof(int) * kMaxHandOffFds)];
+    ::bzero(control, sizeof control);
+    struct msghdr msg;
+    ::bzero(&msg, sizeof msg);
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    ::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    ssize_t n = ::sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+    ::close(sockfd);
+    if (n != 1) {
+        LOG_ERROR("TcpServer::handOffListenSockets sendmsg errno=%d \n", errno);
+        return false;
+    }
+    LOG_INFO("TcpServer::handOffListenSockets [%s] - %zu sockets to %s \n",
+             name_.c_str(), fds.size(), unixPath.c_str());
+    return true;
+}
+
+std::vector<int> TcpServer::receiveListenSockets(const std::string &unixPath,
+                                                 double timeoutSeconds) {
+    std::vector<int> fds;
+    sockaddr_un addr;
+    ::bzero(&addr, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (unixPath.size() >= sizeof addr.sun_path) {
+        LOG_ERROR("TcpServer::receiveListenSockets path too long: %s \n",
+                  unixPath.c_str());
+        return fds;
+    }
+    ::strncpy(addr.sun_path, unixPath.c_str(), sizeof addr.sun_path - 1);
+
+    int listenfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenfd < 0) {
+        LOG_ERROR("TcpServer::receiveListenSockets socket errno=%d \n", errno);
+        return fds;
+    }
+    ::unlink(unixPath.c_str());
+    if (::bind(listenfd, (sockaddr *)&addr, sizeof addr) < 0 ||
+        ::listen(listenfd, 1) < 0) {
+        LOG_ERROR("TcpServer::receiveListenSockets bind %s errno=%d \n",
+                  unixPath.c_str(), errno);
+        ::close(listenfd);
+        return fds;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = listenfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int timeoutMs = static_cast<int>(timeoutSeconds * 1000);
+    int connfd = -1;
+    if (::poll(&pfd, 1, timeoutMs) == 1) {
+        connfd = ::accept4(listenfd, nullptr, nullptr, SOCK_CLOEXEC);
+    }
+    ::close(listenfd);
+    ::unlink(unixPath.c_str());
+    if (connfd < 0) {
+        LOG_ERROR("TcpServer::receiveListenSockets no sockets received from "
+                  "%s \n",
+                  unixPath.c_str());
+        return fds;
+    }
+
+    char one;
+    struct iovec vec;
+    vec.iov_base = &one;
+    vec.iov_len = 1;
+    char control[CMSG_SPACE(sizeof(int) * kMaxHandOffFds)];
+    struct msghdr msg;
+    ::bzero(&msg, sizeof msg);
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    // 收到的fd也要设置close-on-exec
+    ssize_t n = ::recvmsg(connfd, &msg, MSG_CMSG_CLOEXEC);
+    ::close(connfd);
+    if (n <= 0) {
+        LOG_ERROR("TcpServer::receiveListenSockets recvmsg errno=%d \n", errno);
+        return fds;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *received = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+            fds.assign(received, received + count);
+        }
+    }
+    return fds;
 }
 
 // 有一个新的客户端的连接，acceptor会执行这个回调操作
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
-    // 轮询算法选择一个subLoop，来管理channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_, nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
+    // 按分配策略（默认轮询）选择一个subLoop，来管理channel
+    EventLoop *ioLoop = threadPool_->getLoopForConnection(peerAddr);
+    newConnectionInLoop(ioLoop, sockfd, peerAddr);
+}
 
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
-             name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, int sockfd,
+                                    const InetAddress &peerAddr) {
+    // 只分配一个整数编号，连接的名字等到用的时候再拼
+    uint64_t connId = nextConnId_.fetch_add(1, std::memory_order_relaxed);
+
+    LOG_INFO("TcpServer::newConnection [%s] - new connection #%llu from %s \n",
+             name_.c_str(), static_cast<unsigned long long>(connId),
+             peerAddr.toIpPort().c_str());
 
     // 通过sockfd获取其绑定的本机的ip地址和端口信息
     sockaddr_in local;
@@ -73,34 +437,67 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
     InetAddress localAddr(local);
 
     // 根据连接成功的sockfd，创建TcpConnection连接对象
-    TcpConnectionPtr conn(
-        new TcpConnection(ioLoop, connName, sockfd, localAddr, peerAddr));
+    TcpConnectionPtr conn(new TcpConnection(ioLoop, connId, connNamePrefix_,
+                                            sockfd, localAddr, peerAddr));
 
-    connections_[connName] = conn;
     // 下面的回调都是用户设置给TcpServer的 TcpServer 设置给TcpConnection
     // TcpConnection 设置给 Channel Channel 注册到 Poller
     // Poller notify通知 Channel调用回调
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setEdgeTriggered(edgeTriggered_);
+    conn->setChainedBuffers(chainedBuffers_);
+    if (bufferReclaimSeconds_ > 0) {
+        conn->setBufferReclaimTimeout(bufferReclaimSeconds_);
+    }
+    if (zeroCopyThreshold_ > 0) {
+        conn->setZeroCopyThreshold(zeroCopyThreshold_);
+    }
+    conn->setAutoCork(autoCork_);
+    if (readBackpressure_) {
+        conn->setHighWaterMark(backpressureHighWaterMark_);
+        conn->setReadBackpressure(conn, backpressureLowWaterMark_);
+    }
 
     // 设置了如何关闭连接的回调  conn->shutdown()
     conn->setCloseCallback(
         std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
 
-    // 直接调用TcpConnection::connectEstablished
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    // 分配出去就计数，drain不会漏掉还在排队等待登记的连接
+    ++numConnections_;
+    // 在ioLoop里登记连接并调用TcpConnection::connectEstablished
+    ioLoop->runInLoop(std::bind(&TcpServer::establishConnection, this, conn));
+}
+
+void TcpServer::establishConnection(const TcpConnectionPtr &conn) {
+    shardOf(conn->getLoop())->connections[conn->id()] = conn;
+    conn->connectEstablished();
 }
 
+TcpServer::ConnectionShard *TcpServer::shardOf(EventLoop *loop) const {
+    for (const ConnectionShardPtr &shard : shards_) {
+        if (shard->loop == loop) {
+            return shard.get();
+        }
+    }
+    return nullptr;
+}
+
+// closeCallback在连接所在的loop线程里调用，连接也登记在这个loop的分片里，
+// 直接删除，不用再绕到baseLoop
 void TcpServer::removeConnection(const TcpConnectionPtr &conn) {
-    loop_->runInLoop(std::bind(&TcpServer::removeConnetionInLoop, this, conn));
+    conn->getLoop()->runInLoop(
+        std::bind(&TcpServer::removeConnetionInLoop, this, conn));
 }
 
 void TcpServer::removeConnetionInLoop(const TcpConnectionPtr &conn) {
-    LOG_INFO("TcpServer::removeConnetionInLoop [%s] - connection %s\n",
-             name_.c_str(), conn->name().c_str());
+    LOG_INFO("TcpServer::removeConnetionInLoop [%s] - connection #%llu\n",
+             name_.c_str(), static_cast<unsigned long long>(conn->id()));
 
-    size_t n = connections_.erase(conn->name());
     EventLoop *ioLoop = conn->getLoop();
+    if (shardOf(ioLoop)->connections.erase(conn->id()) > 0) {
+        --numConnections_;
+    }
     ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestoryed, conn));
 }
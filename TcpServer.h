@@ -15,21 +15,31 @@
 #include <atomic>
 #include <functional>
 #include <memory>
+#include <stdint.h>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 // 对外的服务器编程使用的类
 class TcpServer : noncopyable {
 public:
     using ThreadInitCallBack = std::function<void(EventLoop *)>;
+    using DrainCallback = std::function<void()>;
 
     enum Option {
         kNoReusePort,
         kReusePort,
+        // 每个subLoop各自持有一个SO_REUSEPORT的Acceptor，由内核把新连接分给各个loop，
+        // 连接在accept它的线程里处理，不再经过baseLoop转交
+        kReusePortPerLoop,
     };
 
     TcpServer(EventLoop *loop, const InetAddress &listenAddr,
               const std::string &nameArg, Option option = kNoReusePort);
+    // 接管旧进程交过来的监听socket（见receiveListenSockets），不再重新bind
+    // kReusePortPerLoop模式下按顺序分给各个loop，socket比loop少时其余loop新建
+    TcpServer(EventLoop *loop, const std::vector<int> &listenFds,
+              const std::string &nameArg, Option option = kNoReusePort);
     ~TcpServer();
 
     void setThreadInitCallback(const ThreadInitCallBack &cb) {
@@ -46,25 +56,125 @@ public:
     }
 
     void setThreadNum(int numThreads);
+    // subLoop使用的IO复用实现（epoll/poll/io_uring），需要在start之前设置
+    void setPollerBackend(PollerBackend backend) {
+        threadPool_->setPollerBackend(backend);
+    }
+
+    // 新连接分配给subLoop的策略，默认轮询，见EventLoopThreadPool::DispatchPolicy
+    // kReusePortPerLoop模式下由内核分配，不使用这个策略
+    void setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy) {
+        threadPool_->setDispatchPolicy(policy);
+    }
+
+    // 新连接使用边沿触发模式（EPOLLET），需要在start之前设置
+    // 读写都会一直进行到EAGAIN，EPOLLOUT常驻注册，省去每次发送不完时的epoll_ctl
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+
+    // 新连接的缓冲区使用subLoop的BufferPool做链式存储，需要在start之前设置
+    // 数据按定长块存放，扩容不再拷贝已有数据，空闲连接不占用缓冲区内存
+    void setChainedBuffers(bool on) { chainedBuffers_ = on; }
+
+    // 新连接连续seconds秒没有读写时收缩缓冲区，见TcpConnection::setBufferReclaimTimeout
+    void setBufferReclaimTimeout(int seconds) {
+        bufferReclaimSeconds_ = seconds;
+    }
+
+    // 新连接上不小于threshold字节的发送使用MSG_ZEROCOPY，见TcpConnection::setZeroCopyThreshold
+    void setZeroCopyThreshold(size_t threshold) {
+        zeroCopyThreshold_ = threshold;
+    }
+
+    // 新连接开启自动合并写，见TcpConnection::setAutoCork，需要在start之前设置
+    void setAutoCork(bool on) { autoCork_ = on; }
+
+    // 新连接开启自动背压：待发送的数据超过highWaterMark时暂停读这个连接，
+    // 降到lowWaterMark以下时恢复，适合echo这类读了就回写的服务，需要在start之前设置
+    void setReadBackpressure(size_t highWaterMark, size_t lowWaterMark) {
+        readBackpressure_ = true;
+        backpressureHighWaterMark_ = highWaterMark;
+        backpressureLowWaterMark_ = lowWaterMark;
+    }
 
     // 开启服务器监听
     void start();
 
+    // 关闭所有监听socket，不再接受新连接，已有的连接不受影响，线程安全
+    // 已经交给新进程的监听socket在新进程里继续accept
+    void stopAccepting();
+
+    // 平滑下线：停止accept，每个连接把输出缓冲区里的数据发完后关闭写端，等对端关闭；
+    // timeoutSeconds秒后还没关闭的连接强制关闭，所有连接都关闭后在baseLoop线程回调cb
+    void drain(double timeoutSeconds, const DrainCallback &cb);
+
+    // 当前的连接数，已经分配给subLoop、还没有建立完成的连接也算在内，线程安全
+    size_t numConnections() const { return numConnections_; }
+
+    // 平滑重启：通过unixPath上的unix域socket用SCM_RIGHTS把所有监听socket交给新进程，
+    // 新进程先调用receiveListenSockets等待，旧进程交出之后再drain
+    // 内核里的监听队列是同一个，交接过程中不会丢SYN；只能在baseLoop线程、start之后调用
+    bool handOffListenSockets(const std::string &unixPath);
+    // 在unixPath上等待旧进程交过来的监听socket，最多等timeoutSeconds秒，失败返回空
+    static std::vector<int> receiveListenSockets(const std::string &unixPath,
+                                                 double timeoutSeconds);
+
 private:
+    static constexpr double kDrainCheckInterval = 0.1; // 平滑下线时检查连接数的间隔（秒）
+    static const size_t kMaxHandOffFds = 64;           // 一次最多交接的监听socket数
+
+    // 用构造好的acceptor（可以为空）初始化，两个公开的构造函数都委托给它
+    TcpServer(EventLoop *loop, const InetAddress &listenAddr,
+              const std::string &nameArg, Option option, Acceptor *acceptor);
+
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    // 在ioLoop上建立连接，kReusePortPerLoop模式下由subLoop的Acceptor在ioLoop线程直接调用
+    void newConnectionInLoop(EventLoop *ioLoop, int sockfd,
+                             const InetAddress &peerAddr);
     void removeConnection(const TcpConnectionPtr &conn);
     void removeConnetionInLoop(const TcpConnectionPtr &conn);
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    using ConnectionMap = std::unordered_map<uint64_t, TcpConnectionPtr>;
+    // 一个loop上的所有连接，只在这个loop线程里增删，不需要加锁
+    struct ConnectionShard {
+        EventLoop *loop;
+        ConnectionMap connections;
+    };
+    using ConnectionShardPtr = std::shared_ptr<ConnectionShard>;
+
+    void stopAcceptingInLoop();
+    // 在loop线程里销毁它的Acceptor，并确认这个loop已经停止accept
+    void stopLoopAccepting(EventLoop *loop);
+    // 销毁loop上的Acceptor，只能在这个loop线程里调用
+    void destroyLoopAcceptors(EventLoop *loop);
+    void addLoopAcceptor(EventLoop *ioLoop, Acceptor *acceptor);
+    void drainInLoop(double timeoutSeconds, const DrainCallback &cb);
+    void checkDrain();
+    // 在各个连接所在的loop里对每个连接调用fn
+    void forEachConnection(void (TcpConnection::*fn)());
+
+    // 在ioLoop线程里把连接登记到ioLoop的分片，然后建立连接
+    void establishConnection(const TcpConnectionPtr &conn);
+    // loop数量不多，直接顺序查找；shards_在start之后不再变化，可以多线程读
+    ConnectionShard *shardOf(EventLoop *loop) const;
+
     EventLoop *loop_; // baseLoop 用户定义的loop
 
+    const InetAddress listenAddr_;
     const std::string ipPort_;
     const std::string name_;
+    const Option option_;
+    // 连接名字的前缀 name-ip:port，所有连接共享
+    const std::shared_ptr<const std::string> connNamePrefix_;
 
     std::unique_ptr<Acceptor>
         acceptor_; // 运行在mainloop，任务就是监听新连接事件
 
     std::shared_ptr<EventLoopThreadPool> threadPool_;
+    // kReusePortPerLoop模式下每个subLoop自己的Acceptor，下标和loopAcceptorLoops_对应
+    std::vector<std::unique_ptr<Acceptor>> loopAcceptors_;
+    std::vector<EventLoop *> loopAcceptorLoops_;
+    // 从旧进程继承、还没有交给Acceptor的监听socket，start时分配
+    std::vector<int> inheritedFds_;
 
     ConnectionCallback connectionCallback_;       // 有新连接时的回调
     MessageCallback messageCallback_;             // 有读写消息时的回调
@@ -72,7 +182,26 @@ private:
 
     ThreadInitCallBack threadInitCallBack_; // loop线程初始化的回调
     std::atomic_int started_;
-
-    int nextConnId_;
-    ConnectionMap connections_; // 保存所有的连接
+    bool edgeTriggered_;
+    bool chainedBuffers_;
+    int bufferReclaimSeconds_;
+    size_t zeroCopyThreshold_;
+    bool autoCork_;
+    bool readBackpressure_;
+    size_t backpressureHighWaterMark_;
+    size_t backpressureLowWaterMark_;
+
+    std::atomic<uint64_t> nextConnId_;
+    std::vector<ConnectionShardPtr> shards_; // 按loop分片保存所有的连接
+    std::atomic<size_t> numConnections_;
+    bool acceptingStopped_; // 只在baseLoop线程访问
+    // 停止accept之后还没有确认的loop数，drain要等它降到0
+    std::atomic<size_t> acceptorStopsPending_;
+
+    // 平滑下线的状态，只在baseLoop线程访问
+    bool draining_;
+    bool drainForced_; // 已经过了期限，剩下的连接都强制关闭了
+    Timestamp drainDeadline_;
+    TimerId drainTimer_;
+    DrainCallback drainCallback_;
 };
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Callbacks.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+#include <atomic>
+
+// 定时器，记录到期时间、回调以及重复间隔，只被TimerQueue使用
+class Timer : noncopyable {
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb)), expiration_(when), interval_(interval),
+          repeat_(interval > 0.0), sequence_(++s_numCreated_) {}
+
+    void run() const { callback_(); }
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 重复定时器到期后，计算下一次的到期时间
+    void restart(Timestamp now);
+
+    static int64_t numCreated() { return s_numCreated_; }
+
+private:
+    const TimerCallback callback_;
+    Timestamp expiration_;
+    const double interval_; // 秒
+    const bool repeat_;
+    const int64_t sequence_; // 全局唯一的序号，用来区分地址相同的新旧Timer
+
+    static std::atomic<int64_t> s_numCreated_;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+// 用户持有的定时器句柄，用于EventLoop::cancel
+// 只保存Timer的地址和序号，Timer本身由TimerQueue管理
+class TimerId {
+public:
+    TimerId() : timer_(nullptr), sequence_(0) {}
+    TimerId(Timer *timer, int64_t seq) : timer_(timer), sequence_(seq) {}
+
+private:
+    friend class TimerQueue;
+
+    Timer *timer_;
+    int64_t sequence_;
+};
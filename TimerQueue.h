@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Callbacks.h"
+#include "Channel.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+#include "noncopyable.h"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+class EventLoop;
+class Timer;
+
+/**
+ * 每个EventLoop一个定时器队列
+ * 底层用一个timerfd作为Channel注册到loop的Poller上，timerfd总是设置为最早到期的时间，
+ * 到期后handleRead一次取出所有已经到期的定时器执行
+ * 定时器按(到期时间, Timer*)有序存放在std::set中，插入和取消都是O(log n)
+ */
+class TimerQueue : noncopyable {
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全，可以在其他线程调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+
+private:
+    using Entry = std::pair<Timestamp, Timer *>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer *, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读，说明有定时器到期了
+    void handleRead();
+    // 取出所有到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    // 重复定时器重新插入，一次性定时器释放
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+    // 返回新插入的定时器是否成为最早到期的那个
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    TimerList timers_;          // 按到期时间排序
+    ActiveTimerSet activeTimers_; // 按Timer地址排序，和timers_保存的是同一批定时器
+
+    bool callingExpiredTimers_;
+    ActiveTimerSet cancelingTimers_; // 在到期回调里被取消的定时器
+};
@@ -1,5 +1,6 @@
 #include "Timestamp.h"
 
+#include <sys/time.h>
 #include <time.h>
 
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0) {}
@@ -7,14 +8,24 @@ Timestamp::Timestamp() : microSecondsSinceEpoch_(0) {}
 Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
     : microSecondsSinceEpoch_(microSecondsSinceEpoch) {}
 
-Timestamp Timestamp::now() { return Timestamp(time(NULL)); }
+// 定时器需要微秒精度，不能再用time(NULL)
+Timestamp Timestamp::now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t seconds = tv.tv_sec;
+    return Timestamp(seconds * kMicroSecondsPerSecond + tv.tv_usec);
+}
 
 std::string Timestamp::toString() const {
-    char buf[120] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
-    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d", tm_time->tm_year + 1900,
-             tm_time->tm_mon + 1, tm_time->tm_mday, tm_time->tm_hour,
-             tm_time->tm_min, tm_time->tm_sec);
+    char buf[128] = {0};
+    // 多个线程会同时写日志，localtime返回的是静态存储，这里使用可重入的localtime_r
+    time_t seconds =
+        static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);
+    tm tm_time;
+    localtime_r(&seconds, &tm_time);
+    snprintf(buf, sizeof buf, "%4d/%02d/%02d %02d:%02d:%02d",
+             tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+             tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
     return buf;
 }
 
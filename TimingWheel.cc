@@ -0,0 +1,126 @@
+#include "TimingWheel.h"
+#include "EventLoop.h"
+
+TimingWheel::TimingWheel(EventLoop *loop, int numBuckets, double tickSeconds)
+    : loop_(loop), buckets_(numBuckets > 0 ? numBuckets : 1, nullptr),
+      expired_(nullptr), currentTick_(0), size_(0) {
+    loop_->runEvery(tickSeconds, std::bind(&TimingWheel::onTick, this));
+}
+
+// 时间轮只随EventLoop一起析构，紧接着TimerQueue也会析构并释放tick定时器，
+// 这里不再cancel，避免在EventLoop析构的过程中投递回调
+TimingWheel::~TimingWheel() {
+    for (Entry *head : buckets_) {
+        deleteList(head);
+    }
+    deleteList(expired_);
+}
+
+void TimingWheel::deleteList(Entry *head) {
+    while (head != nullptr) {
+        Entry *next = head->next;
+        if (head->owner != nullptr) {
+            *head->owner = nullptr;
+        }
+        delete head;
+        head = next;
+    }
+}
+
+TimingWheel::Entry *TimingWheel::add(int timeoutTicks, ExpireCallback cb,
+                                     Entry **owner) {
+    Entry *entry = new Entry;
+    entry->prev = nullptr;
+    entry->next = nullptr;
+    entry->lastActive = currentTick_;
+    entry->timeout = timeoutTicks > 0 ? timeoutTicks : 1;
+    entry->bucket = 0;
+    entry->linked = false;
+    entry->owner = owner;
+    entry->callback = std::move(cb);
+    link(entry, entry->lastActive + entry->timeout);
+    ++size_;
+    if (owner != nullptr) {
+        *owner = entry;
+    }
+    return entry;
+}
+
+void TimingWheel::remove(Entry *entry) {
+    unlink(entry);
+    --size_;
+    delete entry;
+}
+
+void TimingWheel::restart(Entry *entry) {
+    entry->lastActive = currentTick_;
+    if (!entry->linked) {
+        unlink(entry);
+        link(entry, entry->lastActive + entry->timeout);
+    }
+}
+
+void TimingWheel::link(Entry *entry, uint64_t deadline) {
+    entry->bucket = deadline % buckets_.size();
+    Entry *&head = buckets_[entry->bucket];
+    entry->prev = nullptr;
+    entry->next = head;
+    if (head != nullptr) {
+        head->prev = entry;
+    }
+    head = entry;
+    entry->linked = true;
+}
+
+void TimingWheel::linkExpired(Entry *entry) {
+    entry->prev = nullptr;
+    entry->next = expired_;
+    if (expired_ != nullptr) {
+        expired_->prev = entry;
+    }
+    expired_ = entry;
+    entry->linked = false;
+}
+
+void TimingWheel::unlink(Entry *entry) {
+    Entry *&head = entry->linked ? buckets_[entry->bucket] : expired_;
+    if (entry->prev != nullptr) {
+        entry->prev->next = entry->next;
+    } else {
+        head = entry->next;
+    }
+    if (entry->next != nullptr) {
+        entry->next->prev = entry->prev;
+    }
+    entry->prev = entry->next = nullptr;
+    entry->linked = false;
+}
+
+void TimingWheel::onTick() {
+    ++currentTick_;
+    Entry *&head = buckets_[currentTick_ % buckets_.size()];
+    Entry *list = head;
+    head = nullptr;
+
+    std::vector<Entry *> expired;
+    while (list != nullptr) {
+        Entry *entry = list;
+        list = list->next;
+
+        uint64_t deadline = entry->lastActive + entry->timeout;
+        if (deadline <= currentTick_) {
+            linkExpired(entry);
+            expired.push_back(entry);
+        } else {
+            // 期间被touch过，或者超时时间比一圈还长，重新挂到到期的格子上
+            link(entry, deadline);
+        }
+    }
+
+    // 回调里可能会remove其他条目，所以等链表处理完了再执行
+    for (Entry *entry : expired) {
+        if (entry->callback) {
+            entry->callback();
+        }
+    }
+}
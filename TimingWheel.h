@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <cstddef>
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * 每个EventLoop一个的哈希时间轮，用于大量连接的空闲超时检测
+ * 时间轮每tickSeconds秒前进一格，每个格子是一个侵入式双向链表
+ *
+ * touch只记录最近一次活跃的tick，不移动链表节点，所以是O(1)且非常便宜；
+ * 指针转到某个格子时才检查其中的条目：已经超时的执行回调，
+ * 期间被touch过的按新的到期时间重新挂到对应的格子上（惰性重排）
+ * 所有接口都只能在loop所在线程调用，超时回调里不能同步remove条目，需要queueInLoop延后
+ */
+class TimingWheel : noncopyable {
+public:
+    using ExpireCallback = std::function<void()>;
+
+    struct Entry {
+        Entry *prev;
+        Entry *next;
+        uint64_t lastActive; // 最近一次活跃时的tick
+        uint64_t timeout;    // 超时的tick数
+        size_t bucket;       // 所在的格子
+        bool linked;         // 在某个格子里；已经超时的条目挂在expired_链表上
+        Entry **owner;       // 时间轮析构时置空，可以为nullptr
+        ExpireCallback callback;
+    };
+
+    TimingWheel(EventLoop *loop, int numBuckets = 256,
+                double tickSeconds = 1.0);
+    ~TimingWheel();
+
+    // 添加一个条目，timeoutTicks个tick内没有touch就执行cb，返回的条目由时间轮持有
+    // owner是调用者保存条目指针的位置，时间轮先于调用者析构时（比如连接比loop活得久）
+    // 会把*owner置空，调用者不会拿着已经释放的条目
+    Entry *add(int timeoutTicks, ExpireCallback cb, Entry **owner = nullptr);
+    // 标记条目在当前tick活跃
+    void touch(Entry *entry) { entry->lastActive = currentTick_; }
+    // 把已经超时的条目重新挂到时间轮上，从当前tick开始重新计时
+    void restart(Entry *entry);
+    // 删除条目，无论是否已经超时都必须调用一次来释放
+    void remove(Entry *entry);
+
+    size_t size() const { return size_; }
+
+private:
+    void onTick();
+    void link(Entry *entry, uint64_t deadline);
+    void linkExpired(Entry *entry);
+    // 从所在的格子或者expired_链表上摘下来
+    void unlink(Entry *entry);
+    void deleteList(Entry *head);
+
+    EventLoop *loop_;
+    std::vector<Entry *> buckets_; // 每个格子链表的头节点
+    Entry *expired_;               // 已经超时、还没有restart或remove的条目
+    uint64_t currentTick_;
+    size_t size_;
+};
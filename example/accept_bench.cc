@@ -0,0 +1,99 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 新连接接入速率测试：对比kReusePort（baseLoop一个Acceptor再分给subLoop）
+ * 和kReusePortPerLoop（每个subLoop各自accept）在1~16个loop下每秒能接入的连接数
+ * 客户端线程不停地connect，读到服务器发来的一个字节后用RST关闭
+ * 用法：./accept_bench [每组秒数] [客户端线程数] [端口]
+ */
+static std::atomic<long> g_completed(0);
+
+static void connectLoop(uint16_t port, std::chrono::steady_clock::time_point end) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    while (std::chrono::steady_clock::now() < end) {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) {
+            continue;
+        }
+        if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) == 0) {
+            char c;
+            if (::read(sockfd, &c, 1) == 1) {
+                ++g_completed;
+            }
+        }
+        // RST关闭，客户端不留TIME_WAIT，避免端口耗尽
+        struct linger lin = {1, 0};
+        ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &lin, sizeof lin);
+        ::close(sockfd);
+    }
+}
+
+static double runOnce(TcpServer::Option option, int numLoops, double seconds,
+                      int clients, uint16_t port) {
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "AcceptBench", option);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected()) {
+            conn->send("x");
+        }
+    });
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    // kReusePort模式下accept在baseLoop，numLoops个subLoop处理连接；
+    // kReusePortPerLoop模式下numLoops个subLoop各自accept
+    server.setThreadNum(numLoops);
+    server.start();
+
+    g_completed = 0;
+    std::chrono::steady_clock::time_point end =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(static_cast<int>(seconds * 1000));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) {
+        threads.push_back(std::thread(connectLoop, port, end));
+    }
+    loop.runAfter(seconds + 0.2, [&loop]() { loop.quit(); });
+    loop.loop();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    return g_completed / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int clients = argc > 2 ? atoi(argv[2]) : 4;
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+    // 客户端用RST关闭，服务器端每个连接都会打一条handleError，这里全部关掉
+    Logger::instance().setLogLevel(FATAL);
+
+    printf("%-6s %18s %18s\n", "loops", "kReusePort conn/s",
+           "PerLoop conn/s");
+    const int kLoops[] = {1, 2, 4, 8, 16};
+    for (int numLoops : kLoops) {
+        double shared =
+            runOnce(TcpServer::kReusePort, numLoops, seconds, clients, port);
+        double perLoop = runOnce(TcpServer::kReusePortPerLoop, numLoops,
+                                 seconds, clients, port);
+        printf("%-6d %18.0f %18.0f\n", numLoops, shared, perLoop);
+    }
+    return 0;
+}
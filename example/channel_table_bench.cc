@@ -0,0 +1,202 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 连接建立/关闭周转时Poller登记表的开销
+ * 第一部分按connect/close的顺序重放登记表操作（登记、查找、删除），
+ * 对比原来的unordered_map<int, Channel*>和现在按fd下标的数组
+ * 第二部分是端到端：保持若干空闲连接，客户端不停connect再RST关闭，统计每秒接入数
+ * 用法：./channel_table_bench [空闲连接数] [每组秒数] [客户端线程数] [端口]
+ */
+static double wallSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t g_random = 88172645463325252ULL;
+static size_t nextIndex(size_t n) {
+    g_random ^= g_random << 13;
+    g_random ^= g_random >> 7;
+    g_random ^= g_random << 17;
+    return static_cast<size_t>(g_random % n);
+}
+
+// 内核总是分配最小的空闲fd，关闭一个再打开一个，新fd就是刚关掉的那个
+// 每次周转：登记新fd，enable/disable各查一次，删除
+template <typename Table>
+static double replay(Table &table, size_t idle, long cycles) {
+    std::vector<int> live;
+    for (size_t i = 0; i < idle || live.empty(); ++i) {
+        int fd = static_cast<int>(i + 16);
+        table.add(fd);
+        live.push_back(fd);
+    }
+    long found = 0;
+    double start = wallSeconds();
+    for (long i = 0; i < cycles; ++i) {
+        size_t slot = nextIndex(live.size());
+        int fd = live[slot];
+        table.erase(fd);
+        table.add(fd);
+        found += table.find(fd) + table.find(fd);
+    }
+    double elapsed = wallSeconds() - start;
+    if (found != cycles * 2) {
+        printf("replay lost channels\n");
+    }
+    return elapsed * 1e9 / cycles;
+}
+
+struct MapTable {
+    std::unordered_map<int, Channel *> channels;
+    void add(int fd) { channels[fd] = reinterpret_cast<Channel *>(this); }
+    void erase(int fd) { channels.erase(fd); }
+    int find(int fd) {
+        auto it = channels.find(fd);
+        return it != channels.end() && it->second != nullptr;
+    }
+};
+
+struct ArrayTable {
+    std::vector<Channel *> channels;
+    void add(int fd) {
+        if (static_cast<size_t>(fd) >= channels.size()) {
+            channels.resize(fd * 2 + 1, nullptr);
+        }
+        channels[fd] = reinterpret_cast<Channel *>(this);
+    }
+    void erase(int fd) { channels[fd] = nullptr; }
+    int find(int fd) {
+        return static_cast<size_t>(fd) < channels.size() &&
+               channels[fd] != nullptr;
+    }
+};
+
+static std::atomic<long> g_completed(0);
+
+static int connectTo(uint16_t port) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd >= 0 && ::connect(sockfd, (sockaddr *)&addr, sizeof addr) < 0) {
+        ::close(sockfd);
+        sockfd = -1;
+    }
+    return sockfd;
+}
+
+static void churnLoop(uint16_t port, std::chrono::steady_clock::time_point end) {
+    while (std::chrono::steady_clock::now() < end) {
+        int sockfd = connectTo(port);
+        if (sockfd < 0) {
+            continue;
+        }
+        char c;
+        if (::read(sockfd, &c, 1) == 1) {
+            ++g_completed;
+        }
+        // RST关闭，客户端不留TIME_WAIT，避免端口耗尽
+        struct linger lin = {1, 0};
+        ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &lin, sizeof lin);
+        ::close(sockfd);
+    }
+}
+
+static double runChurn(size_t idle, double seconds, int clients,
+                       uint16_t port) {
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "ChurnTable");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected()) {
+            conn->send("x");
+        }
+    });
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.start();
+
+    // 驱动线程先建立空闲连接，再启动客户端线程周转，最后让loop退出
+    std::vector<int> idleFds;
+    g_completed = 0;
+    std::thread driver([&loop, &idleFds, idle, seconds, clients, port]() {
+        for (size_t i = 0; i < idle; ++i) {
+            int sockfd = connectTo(port);
+            if (sockfd < 0) {
+                break;
+            }
+            idleFds.push_back(sockfd);
+        }
+        std::chrono::steady_clock::time_point end =
+            std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(static_cast<int>(seconds * 1000));
+        std::vector<std::thread> threads;
+        for (int i = 0; i < clients; ++i) {
+            threads.push_back(std::thread(churnLoop, port, end));
+        }
+        for (std::thread &t : threads) {
+            t.join();
+        }
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+    for (int fd : idleFds) {
+        ::close(fd);
+    }
+    if (idleFds.size() < idle) {
+        printf("only %zu idle connections, raise ulimit -n or somaxconn\n",
+               idleFds.size());
+    }
+    return g_completed / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    size_t idle = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 4000;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    int clients = argc > 3 ? atoi(argv[3]) : 4;
+    uint16_t port = static_cast<uint16_t>(argc > 4 ? atoi(argv[4]) : 9981);
+    const long kCycles = 10000000;
+
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    // 客户端用RST关闭，服务器端每个连接都会打一条handleError，这里全部关掉
+    Logger::instance().setLogLevel(FATAL);
+
+    MapTable map;
+    ArrayTable array;
+    double mapNs = replay(map, idle, kCycles);
+    double arrayNs = replay(array, idle, kCycles);
+    printf("table replay, %zu live fds: unordered_map %.1f ns/cycle, fd array "
+           "%.1f ns/cycle\n",
+           idle, mapNs, arrayNs);
+
+    printf("%-10s %12s\n", "idle", "accepts/s");
+    const size_t kIdle[] = {0, idle};
+    for (size_t n : kIdle) {
+        printf("%-10zu %12.0f\n", n, runChurn(n, seconds, clients, port));
+    }
+    return 0;
+}
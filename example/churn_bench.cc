@@ -0,0 +1,94 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 连接周转测试：每个连接只做一次请求应答就关闭，测量每秒完成的连接数
+ * 覆盖了连接编号分配、按loop分片登记和在同一个loop里删除连接的整个过程
+ * 测试结束后检查服务器的连接数是否回到0
+ * 用法：./churn_bench [每组秒数] [客户端线程数] [端口]
+ */
+static std::atomic<long> g_completed(0);
+
+static void churnLoop(uint16_t port, std::chrono::steady_clock::time_point end) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    while (std::chrono::steady_clock::now() < end) {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) {
+            continue;
+        }
+        if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) == 0) {
+            char c = 'q';
+            if (::write(sockfd, &c, 1) == 1 && ::read(sockfd, &c, 1) == 1) {
+                ++g_completed;
+            }
+        }
+        // RST关闭，客户端不留TIME_WAIT，服务器收到ECONNRESET后删除连接
+        struct linger lin = {1, 0};
+        ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &lin, sizeof lin);
+        ::close(sockfd);
+    }
+}
+
+static void runOnce(int numLoops, double seconds, int clients, uint16_t port) {
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "ChurnBench");
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf->retrieveeAllAsString());
+        });
+    server.setThreadNum(numLoops);
+    server.start();
+
+    g_completed = 0;
+    std::chrono::steady_clock::time_point end =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(static_cast<int>(seconds * 1000));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) {
+        threads.push_back(std::thread(churnLoop, port, end));
+    }
+    size_t leftover = 0;
+    // 客户端停下之后再等一会，让最后一批RST都处理完
+    loop.runAfter(seconds + 0.5, [&loop, &server, &leftover]() {
+        leftover = server.numConnections();
+        loop.quit();
+    });
+    loop.loop();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    printf("%-6d %12.0f %10zu\n", numLoops, g_completed / seconds, leftover);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int clients = argc > 2 ? atoi(argv[2]) : 4;
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+    // 客户端用RST关闭，服务器端每个连接都会打一条handleError，这里全部关掉
+    Logger::instance().setLogLevel(FATAL);
+
+    printf("%-6s %12s %10s\n", "loops", "conn/s", "leftover");
+    const int kLoops[] = {1, 2, 4, 8};
+    for (int numLoops : kLoops) {
+        runOnce(numLoops, seconds, clients, port);
+    }
+    return 0;
+}
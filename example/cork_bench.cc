@@ -0,0 +1,155 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 自动合并写（autoCork）对流水线请求的效果
+ * 服务器在子进程里，每个8字节的请求单独send一个8字节的应答；
+ * 客户端一次发出depth个请求，收齐depth个应答之后再发下一批
+ * 从/proc/<pid>/io读服务器的syscr/syscw（read/write类系统调用次数），折算成每个请求的次数
+ * 用法：./cork_bench [流水线深度] [批数] [端口]
+ */
+static const size_t kRequestSize = 8;
+
+static void runServer(bool autoCork, uint16_t port) {
+    Logger::instance().setLogLevel(ERROR);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "CorkBench");
+    server.setAutoCork(autoCork);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            // 每个请求一次send，合并与否交给autoCork
+            while (buf->readableBytes() >= kRequestSize) {
+                conn->send(std::string(buf->peek(), kRequestSize));
+                buf->retrieve(kRequestSize);
+            }
+        });
+    server.start();
+    loop.loop();
+}
+
+// 服务器进程到目前为止的read类和write类系统调用次数
+static bool syscallCounts(pid_t pid, long *reads, long *writes) {
+    char path[64];
+    snprintf(path, sizeof path, "/proc/%d/io", static_cast<int>(pid));
+    FILE *fp = ::fopen(path, "r");
+    if (fp == nullptr) {
+        return false;
+    }
+    char line[128];
+    *reads = *writes = -1;
+    while (::fgets(line, sizeof line, fp) != nullptr) {
+        ::sscanf(line, "syscr: %ld", reads);
+        ::sscanf(line, "syscw: %ld", writes);
+    }
+    ::fclose(fp);
+    return *reads >= 0 && *writes >= 0;
+}
+
+static int connectTo(uint16_t port) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < 100; ++i) {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) == 0) {
+            return sockfd;
+        }
+        ::close(sockfd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return -1;
+}
+
+static void runOnce(bool autoCork, int depth, int batches, uint16_t port) {
+    pid_t child = ::fork();
+    if (child == 0) {
+        runServer(autoCork, port);
+        _exit(0);
+    }
+    int sockfd = connectTo(port);
+    if (sockfd < 0) {
+        fprintf(stderr, "cannot connect to server\n");
+        ::kill(child, SIGKILL);
+        ::waitpid(child, nullptr, 0);
+        return;
+    }
+
+    const std::string batch(kRequestSize * depth, 'r');
+    std::vector<char> reply(batch.size());
+    long readsBefore = 0;
+    long writesBefore = 0;
+    syscallCounts(child, &readsBefore, &writesBefore);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    int completed = 0;
+    for (; completed < batches; ++completed) {
+        if (::write(sockfd, batch.data(), batch.size()) !=
+            static_cast<ssize_t>(batch.size())) {
+            break;
+        }
+        size_t received = 0;
+        while (received < reply.size()) {
+            // 服务器没有开TCP_NODELAY，不合并写时后面的小应答要等第一个被ACK，
+            // 客户端的延迟ACK会让每批卡40ms，这里每次读之前都要求立即ACK
+            int on = 1;
+            ::setsockopt(sockfd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof on);
+            ssize_t n =
+                ::read(sockfd, &reply[received], reply.size() - received);
+            if (n <= 0) {
+                break;
+            }
+            received += static_cast<size_t>(n);
+        }
+        if (received < reply.size()) {
+            break;
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    long readsAfter = 0;
+    long writesAfter = 0;
+    syscallCounts(child, &readsAfter, &writesAfter);
+
+    double requests = static_cast<double>(completed) * depth;
+    printf("autoCork %-3s %9.0f req/s, server %.3f reads/req, %.3f "
+           "writes/req\n",
+           autoCork ? "on" : "off", requests / seconds,
+           (readsAfter - readsBefore) / requests,
+           (writesAfter - writesBefore) / requests);
+
+    ::close(sockfd);
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+}
+
+int main(int argc, char *argv[]) {
+    int depth = argc > 1 ? atoi(argv[1]) : 64;
+    int batches = argc > 2 ? atoi(argv[2]) : 20000;
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+
+    printf("pipeline depth %d, %d batches\n", depth, batches);
+    runOnce(false, depth, batches, port);
+    runOnce(true, depth, batches, port);
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/EventLoopThreadPool.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 偏斜负载下各个分配策略的尾延迟
+ * 连接按"1个重连接+3个轻连接"的顺序每隔一段时间建立一个：重连接的每个请求在服务器上
+ * 空转1ms，轻连接只是一来一回。轮询会把所有重连接都分到同一个loop上，
+ * 和它们挤在一起的轻连接延迟很高；按负载分配的策略应该把重连接分散开
+ * 服务器在子进程里运行，每个策略单独跑一轮，统计所有轻连接请求的延迟分布
+ * 机器的CPU核数要不少于loop数，否则分散开的重连接还是在同一个核上互相抢占，结果没有意义
+ * 用法：./dispatch_bench [loop数] [每轮测量秒数] [端口]
+ */
+typedef std::chrono::steady_clock Clock;
+
+static const int kGroups = 4;                 // 每组1个重连接、3个轻连接
+static const int kLightPerGroup = 3;
+static const int kHeavyCostUs = 1000;         // 重请求在服务器上的耗时
+static const int kConnectIntervalMs = 150;    // 比loop负载的统计窗口长
+
+static void runServer(uint16_t port, int numLoops,
+                      EventLoopThreadPool::DispatchPolicy policy) {
+    Logger::instance().setLogLevel(ERROR);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "DispatchBench");
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            std::string msg = buf->retrieveeAllAsString();
+            for (char c : msg) {
+                if (c == 'h') {
+                    Clock::time_point end =
+                        Clock::now() + std::chrono::microseconds(kHeavyCostUs);
+                    while (Clock::now() < end) {
+                    }
+                }
+            }
+            conn->send(msg);
+        });
+    server.setThreadNum(numLoops);
+    server.setDispatchPolicy(policy);
+    server.start();
+    loop.loop();
+}
+
+static int connectTo(uint16_t port) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < 100; ++i) {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) == 0) {
+            int one = 1;
+            ::setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+            return sockfd;
+        }
+        ::close(sockfd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return -1;
+}
+
+// 一来一回地发送请求，直到stop；measure为true时把每次的往返时间（微秒）记到latencies
+static void pingPong(int sockfd, char request, const std::atomic<bool> &stop,
+                     const std::atomic<bool> &measuring, std::mutex &mutex,
+                     std::vector<long> &latencies) {
+    std::vector<long> local;
+    while (!stop) {
+        Clock::time_point start = Clock::now();
+        char c;
+        if (::write(sockfd, &request, 1) != 1 || ::read(sockfd, &c, 1) != 1) {
+            break;
+        }
+        if (measuring && request == 'l') {
+            local.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                Clock::now() - start)
+                                .count());
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    latencies.insert(latencies.end(), local.begin(), local.end());
+}
+
+static void runPolicy(const char *name, EventLoopThreadPool::DispatchPolicy policy,
+                      int numLoops, double seconds, uint16_t port) {
+    pid_t child = ::fork();
+    if (child == 0) {
+        runServer(port, numLoops, policy);
+        _exit(0);
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<bool> measuring(false);
+    std::mutex mutex;
+    std::vector<long> latencies;
+    std::vector<int> fds;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kGroups * (kLightPerGroup + 1); ++i) {
+        int sockfd = connectTo(port);
+        if (sockfd < 0) {
+            fprintf(stderr, "connect failed\n");
+            break;
+        }
+        fds.push_back(sockfd);
+        char request = i % (kLightPerGroup + 1) == 0 ? 'h' : 'l';
+        threads.push_back(std::thread(pingPong, sockfd, request, std::cref(stop),
+                                      std::cref(measuring), std::ref(mutex),
+                                      std::ref(latencies)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(kConnectIntervalMs));
+    }
+
+    measuring = true;
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(static_cast<int>(seconds * 1000)));
+    stop = true;
+    // 先关掉服务器，阻塞在read上的线程都会返回
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    for (int sockfd : fds) {
+        ::close(sockfd);
+    }
+
+    if (latencies.empty()) {
+        printf("%-20s no samples\n", name);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    printf("%-20s %10zu %10ld %10ld %10ld\n", name, n, latencies[n / 2],
+           latencies[n * 99 / 100], latencies[n - 1]);
+}
+
+int main(int argc, char *argv[]) {
+    int numLoops = argc > 1 ? atoi(argv[1]) : 4;
+    double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+
+    printf("%-20s %10s %10s %10s %10s\n", "policy", "requests", "p50(us)",
+           "p99(us)", "max(us)");
+    runPolicy("kRoundRobin", EventLoopThreadPool::kRoundRobin, numLoops, seconds,
+              port);
+    runPolicy("kLeastConnections", EventLoopThreadPool::kLeastConnections,
+              numLoops, seconds, port);
+    runPolicy("kLeastBusy", EventLoopThreadPool::kLeastBusy, numLoops, seconds,
+              port);
+    runPolicy("kPowerOfTwoChoices", EventLoopThreadPool::kPowerOfTwoChoices,
+              numLoops, seconds, port);
+    runPolicy("kHashByPeer", EventLoopThreadPool::kHashByPeer, numLoops, seconds,
+              port);
+    return 0;
+}
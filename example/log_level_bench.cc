@@ -0,0 +1,86 @@
+// 本文件里的日志宏全部保留，由运行期阈值决定是否格式化
+#define MUDUO_MIN_LOG_LEVEL 0
+
+#include <mymuduo/Channel.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * 不同日志级别下每秒能处理的事件数
+ * 一个eventfd不停地自己唤醒自己，每个事件打一条TRACE和一条DEBUG，
+ * 和poller、Channel、TcpConnection里逐事件的日志相当
+ * 日志输出换成只计字节数的空输出，测的是格式化的开销而不是终端的速度
+ * "none"一组的回调里没有日志语句，相当于编译期去掉了日志
+ * 用法：./log_level_bench [每组运行秒数]
+ */
+static long g_bytes = 0;
+
+static double wallSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double runOnce(int level, bool withLogs, double seconds) {
+    Logger::instance().setLogLevel(level);
+    EventLoop loop;
+    int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(&loop, fd);
+    long events = 0;
+    channel.setReadCallBack([fd, withLogs, &events](Timestamp receiveTime) {
+        uint64_t value = 0;
+        ::read(fd, &value, sizeof value);
+        ++events;
+        if (withLogs) {
+            LOG_TRACE("fd=%d readable at %ld, event %ld \n", fd,
+                      static_cast<long>(receiveTime.microSecondsSinceEpoch()),
+                      events);
+            LOG_DEBUG("fd=%d value=%lu \n", fd,
+                      static_cast<unsigned long>(value));
+        }
+        uint64_t one = 1;
+        ::write(fd, &one, sizeof one);
+    });
+    channel.enableReading();
+
+    loop.runAfter(seconds, [&loop]() { loop.quit(); });
+    double start = wallSeconds();
+    loop.loop();
+    double elapsed = wallSeconds() - start;
+
+    channel.disableAll();
+    channel.remove();
+    ::close(fd);
+    return events / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    Logger::instance().setOutput(
+        [](const char *, size_t len) { g_bytes += static_cast<long>(len); });
+
+    struct Level {
+        const char *name;
+        int level;
+        bool withLogs;
+    };
+    const Level kLevels[] = {
+        {"TRACE", TRACE, true}, {"DEBUG", DEBUG, true},
+        {"INFO", INFO, true},   {"ERROR", ERROR, true},
+        {"none", ERROR, false},
+    };
+    printf("%-6s %12s %14s\n", "level", "events/s", "log bytes/s");
+    for (const Level &level : kLevels) {
+        g_bytes = 0;
+        double rate = runOnce(level.level, level.withLogs, seconds);
+        printf("%-6s %12.0f %14.0f\n", level.name, rate, g_bytes / seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <mymuduo/MpscQueue.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+/**
+ * queueInLoop的竞争测试：对比EventLoop原来的mutex+swap和现在的MpscQueue
+ * 1~32个生产者线程同时投递Functor，一个消费者线程成批取出并执行
+ * 用法：./mpsc_bench [每轮投递总数]
+ */
+typedef std::function<void()> Functor;
+
+// EventLoop改造之前的做法：入队加锁push_back，消费者加锁swap出来再执行
+class MutexQueue {
+public:
+    void push(Functor cb) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        functors_.push_back(std::move(cb));
+    }
+
+    template <typename Func>
+    size_t drain(Func &&func) {
+        std::vector<Functor> functors;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            functors.swap(functors_);
+        }
+        for (const Functor &functor : functors) {
+            func(functor);
+        }
+        return functors.size();
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<Functor> functors_;
+};
+
+// 返回每秒处理的Functor个数（百万）
+template <typename Queue>
+double runOnce(int producers, size_t total) {
+    Queue queue;
+    std::atomic<size_t> executed(0);
+    std::atomic<bool> go(false);
+    size_t perProducer = total / producers;
+    size_t expected = perProducer * producers;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i) {
+        threads.push_back(std::thread([&queue, &executed, &go, perProducer]() {
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (size_t n = 0; n < perProducer; ++n) {
+                queue.push([&executed]() {
+                    executed.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+        }));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    size_t consumed = 0;
+    while (consumed < expected) {
+        size_t n = queue.drain([](const Functor &functor) { functor(); });
+        if (n == 0) {
+            std::this_thread::yield();
+        }
+        consumed += n;
+    }
+    auto end = std::chrono::steady_clock::now();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return static_cast<double>(executed.load()) / seconds / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    size_t total = 2000000;
+    if (argc > 1) {
+        total = static_cast<size_t>(atol(argv[1]));
+    }
+
+    printf("%-10s %16s %16s\n", "producers", "mutex+swap Mops", "MpscQueue Mops");
+    const int kProducers[] = {1, 2, 4, 8, 16, 32};
+    for (int producers : kProducers) {
+        // 先各跑一轮预热，让MpscQueue的节点池和malloc的缓存都进入稳定状态
+        runOnce<MutexQueue>(producers, total / 10);
+        runOnce<MpscQueue<Functor>>(producers, total / 10);
+        double mutexRate = runOnce<MutexQueue>(producers, total);
+        double mpscRate = runOnce<MpscQueue<Functor>>(producers, total);
+        printf("%-10d %16.2f %16.2f\n", producers, mutexRate, mpscRate);
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <mymuduo/Channel.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+
+/**
+ * poll和epoll在不同fd数量下的开销
+ * 每个loop注册n个eventfd，只有少量令牌在它们之间传递：
+ * 读回调消费掉自己的令牌，再随机写另一个eventfd把令牌传出去
+ * 活跃fd始终很少，poll每轮要扫描全部pollfd，epoll只返回就绪的那几个
+ * 用法：./poller_bench [令牌数] [每组运行秒数]
+ */
+static double wallSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double threadCpuSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t g_random = 88172645463325252ULL;
+static size_t nextIndex(size_t n) {
+    g_random ^= g_random << 13;
+    g_random ^= g_random >> 7;
+    g_random ^= g_random << 17;
+    return static_cast<size_t>(g_random % n);
+}
+
+static void raiseFdLimit(size_t need) {
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < need) {
+        rl.rlim_cur = rl.rlim_max < need ? rl.rlim_max : need;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static void runOnce(const char *name, PollerBackend backend, size_t nfds,
+                    int tokens, double seconds) {
+    EventLoop loop(backend);
+    std::vector<int> fds;
+    std::vector<std::unique_ptr<Channel>> channels;
+    long events = 0;
+
+    for (size_t i = 0; i < nfds; ++i) {
+        int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            printf("%-6s %6zu fds: eventfd failed after %zu fds, raise ulimit "
+                   "-n\n",
+                   name, nfds, i);
+            for (int opened : fds) {
+                ::close(opened);
+            }
+            return;
+        }
+        fds.push_back(fd);
+    }
+
+    double start = wallSeconds();
+    for (size_t i = 0; i < nfds; ++i) {
+        Channel *channel = new Channel(&loop, fds[i]);
+        int fd = fds[i];
+        channel->setReadCallBack([fd, &fds, &events](Timestamp) {
+            uint64_t value = 0;
+            if (::read(fd, &value, sizeof value) != sizeof value) {
+                return;
+            }
+            // 收到几个令牌就传出去几个
+            for (uint64_t k = 0; k < value; ++k) {
+                uint64_t one = 1;
+                ::write(fds[nextIndex(fds.size())], &one, sizeof one);
+            }
+            events += static_cast<long>(value);
+        });
+        channel->enableReading();
+        channels.emplace_back(channel);
+    }
+    double registerSeconds = wallSeconds() - start;
+
+    for (int i = 0; i < tokens; ++i) {
+        uint64_t one = 1;
+        ::write(fds[nextIndex(fds.size())], &one, sizeof one);
+    }
+
+    loop.runAfter(seconds, [&loop]() { loop.quit(); });
+    double cpuStart = threadCpuSeconds();
+    start = wallSeconds();
+    loop.loop();
+    double elapsed = wallSeconds() - start;
+    double cpu = threadCpuSeconds() - cpuStart;
+
+    printf("%-6s %6zu fds: register %6.0f ns/fd, %9.0f events/s, %6.2f us "
+           "cpu/event\n",
+           name, nfds, registerSeconds * 1e9 / nfds, events / elapsed,
+           events > 0 ? cpu * 1e6 / events : 0.0);
+
+    for (auto &channel : channels) {
+        channel->disableAll();
+        channel->remove();
+    }
+    for (int fd : fds) {
+        ::close(fd);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int tokens = argc > 1 ? atoi(argv[1]) : 4;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    const size_t kSizes[] = {8, 64, 10000};
+
+    Logger::instance().setLogLevel(FATAL);
+    raiseFdLimit(10000 + 64);
+    printf("%d tokens in flight, %.1f s per run\n", tokens, seconds);
+    for (size_t nfds : kSizes) {
+        runOnce("poll", kPollPoller, nfds, tokens, seconds);
+        runOnce("epoll", kEPollPoller, nfds, tokens, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <mymuduo/Buffer.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Buffer::readFd在小消息下的读吞吐和内存占用
+ * n个socketpair模拟n个连接，每一轮给每个连接写一条消息，再用readFd读出来并取走，
+ * 统计每秒读到的消息数、字节数，以及最后所有Buffer的容量
+ * 小消息时Buffer应该保持初始大小，大消息持续读满之后才扩到预期读取大小
+ * 用法：./read_bench [连接数] [轮数]
+ */
+static double wallSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void runOnce(size_t numConns, int rounds, size_t messageBytes) {
+    std::vector<int> readers;
+    std::vector<int> writers;
+    for (size_t i = 0; i < numConns; ++i) {
+        int sv[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+            fprintf(stderr, "socketpair failed after %zu: %s\n", i,
+                    strerror(errno));
+            break;
+        }
+        // 大消息一次写进去，不要被socket缓冲区截断
+        int size = static_cast<int>(messageBytes * 2);
+        ::setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof size);
+        ::setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+        writers.push_back(sv[0]);
+        readers.push_back(sv[1]);
+    }
+    std::vector<Buffer> buffers(readers.size());
+    const std::string message(messageBytes, 'x');
+
+    long messages = 0;
+    long bytes = 0;
+    double readSeconds = 0;
+    for (int round = 0; round < rounds; ++round) {
+        for (int fd : writers) {
+            ::write(fd, message.data(), message.size());
+        }
+        double start = wallSeconds();
+        for (size_t i = 0; i < readers.size(); ++i) {
+            int saveErrno = 0;
+            ssize_t n = buffers[i].readFd(readers[i], &saveErrno);
+            if (n > 0) {
+                bytes += n;
+                ++messages;
+            }
+            buffers[i].retrieveAll();
+        }
+        readSeconds += wallSeconds() - start;
+    }
+
+    size_t capacity = 0;
+    for (const Buffer &buffer : buffers) {
+        capacity += buffer.capacity();
+    }
+    printf("%6zu B msgs: %9.0f reads/s, %8.1f MB/s, buffer %6.1f KB/conn\n",
+           messageBytes, messages / readSeconds, bytes / readSeconds / 1e6,
+           buffers.empty() ? 0.0 : capacity / 1024.0 / buffers.size());
+
+    for (int fd : readers) {
+        ::close(fd);
+    }
+    for (int fd : writers) {
+        ::close(fd);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t numConns = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 5000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 100;
+
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    printf("%zu connections, %d rounds\n", numConns, rounds);
+    const size_t kSizes[] = {64, 512, 4096, 32768};
+    for (size_t messageBytes : kSizes) {
+        runOnce(numConns, rounds, messageBytes);
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+
+/**
+ * 四层TCP代理：客户端连上来之后连接上游服务器，两个连接之间用splice互相转发
+ * 用法：./relay 监听端口 上游ip 上游端口 [copy]
+ * 最后加上copy参数时走普通的读到Buffer再send的路径，可以用来对比吞吐
+ */
+class RelayServer {
+public:
+    RelayServer(EventLoop *loop, const InetAddress &listenAddr,
+                const InetAddress &upstreamAddr, bool copy)
+        : server_(loop, listenAddr, "RelayServer"),
+          upstreamAddr_(upstreamAddr), copy_(copy) {
+        server_.setConnectionCallback(
+            std::bind(&RelayServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback(
+            std::bind(&RelayServer::onMessage, this, std::placeholders::_1,
+                      std::placeholders::_2, std::placeholders::_3));
+        server_.setThreadNum(2);
+    }
+
+    void start() { server_.start(); }
+
+private:
+    // 示例里直接阻塞connect上游，真正的代理应该使用非阻塞connect
+    int connectUpstream() {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) {
+            return -1;
+        }
+        const sockaddr_in *addr = upstreamAddr_.getSockAddr();
+        if (::connect(sockfd, (const sockaddr *)addr, sizeof *addr) < 0) {
+            ::close(sockfd);
+            return -1;
+        }
+        ::fcntl(sockfd, F_SETFL, ::fcntl(sockfd, F_GETFL) | O_NONBLOCK);
+        return sockfd;
+    }
+
+    void onConnection(const TcpConnectionPtr &conn) {
+        if (!conn->connected()) {
+            TcpConnectionPtr upstream = takeUpstream(conn->name());
+            if (upstream) {
+                upstream->forceClose();
+            }
+            return;
+        }
+
+        int sockfd = connectUpstream();
+        if (sockfd < 0) {
+            LOG_ERROR("connect upstream %s failed, errno=%d \n",
+                      upstreamAddr_.toIpPort().c_str(), errno);
+            conn->forceClose();
+            return;
+        }
+
+        sockaddr_in local;
+        socklen_t len = sizeof local;
+        ::memset(&local, 0, sizeof local);
+        ::getsockname(sockfd, (sockaddr *)&local, &len);
+
+        // 上游连接和客户端连接放在同一个loop里，splice需要两边在同一个线程
+        std::weak_ptr<TcpConnection> weakClient(conn);
+        TcpConnectionPtr upstream(
+            new TcpConnection(conn->getLoop(), conn->name() + "-upstream",
+                              sockfd, InetAddress(local), upstreamAddr_));
+        upstream->setConnectionCallback([weakClient](const TcpConnectionPtr &c) {
+            if (!c->connected()) {
+                TcpConnectionPtr client = weakClient.lock();
+                if (client) {
+                    client->forceClose();
+                }
+            }
+        });
+        upstream->setMessageCallback(
+            [weakClient](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+                TcpConnectionPtr client = weakClient.lock();
+                if (client) {
+                    client->send(buf);
+                } else {
+                    buf->retrieveAll();
+                }
+            });
+        upstream->setCloseCallback([](const TcpConnectionPtr &c) {
+            c->getLoop()->queueInLoop(
+                std::bind(&TcpConnection::connectDestoryed, c));
+        });
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            upstreams_[conn->name()] = upstream;
+        }
+        upstream->connectEstablished();
+
+        if (!copy_) {
+            conn->relayTo(upstream);
+            upstream->relayTo(conn);
+        }
+    }
+
+    // 只有copy模式会走到这里
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        TcpConnectionPtr upstream;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = upstreams_.find(conn->name());
+            if (it != upstreams_.end()) {
+                upstream = it->second;
+            }
+        }
+        if (upstream) {
+            upstream->send(buf);
+        } else {
+            buf->retrieveAll();
+        }
+    }
+
+    TcpConnectionPtr takeUpstream(const std::string &name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TcpConnectionPtr upstream;
+        auto it = upstreams_.find(name);
+        if (it != upstreams_.end()) {
+            upstream = it->second;
+            upstreams_.erase(it);
+        }
+        return upstream;
+    }
+
+    TcpServer server_;
+    const InetAddress upstreamAddr_;
+    const bool copy_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, TcpConnectionPtr> upstreams_;
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s listen_port upstream_ip upstream_port [copy]\n",
+                argv[0]);
+        return 1;
+    }
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(atoi(argv[1])));
+    InetAddress upstreamAddr(static_cast<uint16_t>(atoi(argv[3])), argv[2]);
+    bool copy = argc > 4 && strcmp(argv[4], "copy") == 0;
+
+    RelayServer server(&loop, listenAddr, upstreamAddr, copy);
+    server.start();
+    loop.loop();
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 平滑重启测试：压测客户端一直在建立连接，旧进程把监听socket交给新进程后drain退出，
+ * 统计整个过程中失败的连接数，有失败或者旧进程没有正常退出时返回非0
+ * 客户端连上之后要读到服务器发来的一个字节才算成功
+ * 用法：./restart_test [single|perloop] [客户端线程数] [端口]
+ */
+static const char *kHandOffPath = "/tmp/mymuduo_restart_test.sock";
+
+static std::atomic<long> g_succeeded(0);
+static std::atomic<long> g_failed(0);
+static std::atomic<bool> g_stop(false);
+// 旧进程里drain回调之后还建立的连接数，drain完成时应该已经不再accept了
+static std::atomic<int> g_lateConnections(0);
+static std::atomic<bool> g_drained(false);
+
+static void greet(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        conn->send("x");
+    }
+}
+
+static void discard(const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+    buf->retrieveAll();
+}
+
+// 旧进程：新进程在kHandOffPath上等待之后交出监听socket，然后drain，全部关闭后返回
+static bool serveUntilDrained(uint16_t port, TcpServer::Option option) {
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "OldServer", option);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected() && g_drained) {
+            ++g_lateConnections;
+        }
+        greet(conn);
+    });
+    server.setMessageCallback(discard);
+    server.setThreadNum(4);
+    server.start();
+
+    bool handedOff = false;
+    loop.runEvery(0.05, [&loop, &server, &handedOff]() {
+        if (handedOff || ::access(kHandOffPath, F_OK) != 0) {
+            return;
+        }
+        // 新进程可能刚bind还没有listen，失败了下次再试
+        if (server.handOffListenSockets(kHandOffPath)) {
+            handedOff = true;
+            server.drain(2.0, [&loop]() {
+                g_drained = true;
+                loop.quit();
+            });
+        }
+    });
+    loop.loop();
+    return handedOff;
+    // TcpServer在这里析构，drain之后还有loop在accept的话，这期间建立的连接也会被统计到
+}
+
+// 退出码：0正常，1没有完成交接，2 drain完成之后还在接受新连接
+static int runOldServer(uint16_t port, TcpServer::Option option) {
+    if (!serveUntilDrained(port, option)) {
+        return 1;
+    }
+    return g_lateConnections == 0 ? 0 : 2;
+}
+
+// 新进程：接管旧进程的监听socket，一直运行到被父进程杀掉
+static int runNewServer(TcpServer::Option option) {
+    std::vector<int> fds = TcpServer::receiveListenSockets(kHandOffPath, 10.0);
+    if (fds.empty()) {
+        return 1;
+    }
+    EventLoop loop;
+    TcpServer server(&loop, fds, "NewServer", option);
+    server.setConnectionCallback(greet);
+    server.setMessageCallback(discard);
+    server.setThreadNum(4);
+    server.start();
+    loop.loop();
+    return 0;
+}
+
+static void loadLoop(uint16_t port) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    while (!g_stop) {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) {
+            continue;
+        }
+        char c;
+        if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) == 0 &&
+            ::read(sockfd, &c, 1) == 1) {
+            ++g_succeeded;
+        } else {
+            ++g_failed;
+        }
+        // RST关闭，客户端不留TIME_WAIT，避免端口耗尽
+        struct linger lin = {1, 0};
+        ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &lin, sizeof lin);
+        ::close(sockfd);
+    }
+}
+
+static bool waitForServer(uint16_t port) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < 100; ++i) {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int ret = ::connect(sockfd, (sockaddr *)&addr, sizeof addr);
+        ::close(sockfd);
+        if (ret == 0) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    TcpServer::Option option =
+        argc > 1 && strcmp(argv[1], "single") == 0 ? TcpServer::kNoReusePort
+                                                   : TcpServer::kReusePortPerLoop;
+    int clients = argc > 2 ? atoi(argv[2]) : 4;
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+    // 客户端用RST关闭，服务器端每个连接都会打一条handleError，这里全部关掉
+    Logger::instance().setLogLevel(FATAL);
+    ::unlink(kHandOffPath);
+
+    pid_t oldServer = ::fork();
+    if (oldServer == 0) {
+        _exit(runOldServer(port, option));
+    }
+    if (!waitForServer(port)) {
+        fprintf(stderr, "old server did not start\n");
+        ::kill(oldServer, SIGKILL);
+        return 1;
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) {
+        threads.push_back(std::thread(loadLoop, port));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    // 新进程启动后在kHandOffPath上等待，旧进程看到之后交出监听socket
+    pid_t newServer = ::fork();
+    if (newServer == 0) {
+        _exit(runNewServer(option));
+    }
+    int oldStatus = 0;
+    ::waitpid(oldServer, &oldStatus, 0);
+    long failedAtHandOff = g_failed;
+
+    // 旧进程退出后新进程单独再承受一秒的压力
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    g_stop = true;
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    ::kill(newServer, SIGKILL);
+    ::waitpid(newServer, nullptr, 0);
+
+    bool oldExited = WIFEXITED(oldStatus) && WEXITSTATUS(oldStatus) == 0;
+    printf("option %s, succeeded %ld, failed %ld (%ld before the old server "
+           "exited)\n",
+           option == TcpServer::kReusePortPerLoop ? "perloop" : "single",
+           g_succeeded.load(), g_failed.load(), failedAtHandOff);
+    if (oldExited) {
+        printf("old server drained and exited\n");
+    } else if (WIFEXITED(oldStatus)) {
+        printf("old server exited with %d\n", WEXITSTATUS(oldStatus));
+    } else {
+        printf("old server killed by signal %d\n", WTERMSIG(oldStatus));
+    }
+    return oldExited && g_failed == 0 && g_succeeded > 0 ? 0 : 1;
+}
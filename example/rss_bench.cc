@@ -0,0 +1,194 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 大量空闲连接时服务器的常驻内存
+ * 服务器在子进程里做echo，客户端建立n个连接，每个连接收发一条消息之后保持空闲，
+ * 稳定之后读取服务器进程的RSS和连接缓冲区占用的字节数，比较三种缓冲区用法：
+ * vector（默认的连续缓冲区）、vector+reclaim（空闲1秒后回收缓冲区）、chained（BufferPool链式缓冲区）
+ * 每个本地地址最多用两万多个端口，超过之后换下一个127.0.0.x做源地址
+ * 用法：./rss_bench [连接数] [消息字节数] [端口]
+ */
+enum Mode { kVector, kVectorReclaim, kChained };
+
+static void raiseFdLimit() {
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static void runServer(Mode mode, uint16_t port, int64_t *bufferMemory) {
+    raiseFdLimit();
+    Logger::instance().setLogLevel(ERROR);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "RssBench");
+    if (mode == kChained) {
+        server.setChainedBuffers(true);
+    } else if (mode == kVectorReclaim) {
+        server.setBufferReclaimTimeout(1);
+    }
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf->retrieveeAllAsString());
+        });
+    server.start();
+    // free掉的小块内存默认留在malloc里，定期trim让RSS反映真正还在用的内存
+    // 顺便把连接缓冲区占用的字节数写到和父进程共享的内存里
+    loop.runEvery(0.5, [&loop, bufferMemory]() {
+        ::malloc_trim(0);
+        *bufferMemory = loop.bufferMemoryBytes();
+    });
+    loop.loop();
+}
+
+static long rssKb(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof path, "/proc/%d/statm", static_cast<int>(pid));
+    long pages = 0;
+    long resident = 0;
+    FILE *fp = ::fopen(path, "r");
+    if (fp != nullptr) {
+        if (::fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        ::fclose(fp);
+    }
+    return resident * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int connectFrom(uint32_t localIp, uint16_t port) {
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        return -1;
+    }
+    sockaddr_in local;
+    ::memset(&local, 0, sizeof local);
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(localIp);
+    // 端口推迟到connect时再分配，每个源地址各自有一整套临时端口
+    int on = 1;
+    ::setsockopt(sockfd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof on);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(sockfd, (sockaddr *)&local, sizeof local) < 0 ||
+        ::connect(sockfd, (sockaddr *)&addr, sizeof addr) < 0) {
+        ::close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static bool echoOnce(int sockfd, const std::string &message) {
+    if (::write(sockfd, message.data(), message.size()) !=
+        static_cast<ssize_t>(message.size())) {
+        return false;
+    }
+    size_t received = 0;
+    char buf[4096];
+    while (received < message.size()) {
+        ssize_t n = ::read(sockfd, buf, sizeof buf);
+        if (n <= 0) {
+            return false;
+        }
+        received += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void runOnce(const char *name, Mode mode, int numConns,
+                    size_t messageBytes, uint16_t port) {
+    int64_t *bufferMemory = static_cast<int64_t *>(
+        ::mmap(nullptr, sizeof(int64_t), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    *bufferMemory = 0;
+    pid_t child = ::fork();
+    if (child == 0) {
+        runServer(mode, port, bufferMemory);
+        _exit(0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    long before = rssKb(child);
+
+    const std::string message(messageBytes, 'x');
+    const int kConnsPerIp = 25000;
+    std::vector<int> fds;
+    for (int i = 0; i < numConns; ++i) {
+        uint32_t localIp = INADDR_LOOPBACK + 1 + i / kConnsPerIp;
+        int sockfd = connectFrom(localIp, port);
+        if (sockfd < 0) {
+            fprintf(stderr, "%s: connect failed after %d connections: %s\n",
+                    name, i, strerror(errno));
+            break;
+        }
+        fds.push_back(sockfd);
+        if (!echoOnce(sockfd, message)) {
+            fprintf(stderr, "%s: echo failed on connection %d\n", name, i);
+            break;
+        }
+    }
+
+    // 等待空闲回收的定时器触发，之后的内存就是稳定状态
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    long after = rssKb(child);
+    size_t conns = fds.size();
+    double perConn = conns > 0 ? 1.0 / conns : 0.0;
+    printf("%-15s %8zu conns, rss %7ld KB -> %7ld KB, %6.2f KB/conn, buffers "
+           "%6.2f KB/conn\n",
+           name, conns, before, after, (after - before) * perConn,
+           *bufferMemory / 1024.0 * perConn);
+
+    for (int fd : fds) {
+        ::close(fd);
+    }
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+    ::munmap(bufferMemory, sizeof(int64_t));
+}
+
+int main(int argc, char *argv[]) {
+    int numConns = argc > 1 ? atoi(argv[1]) : 100000;
+    size_t messageBytes =
+        argc > 2 ? static_cast<size_t>(atol(argv[2])) : 4096;
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+
+    // 客户端自己也要持有numConns个socket
+    raiseFdLimit();
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < static_cast<rlim_t>(numConns) + 64) {
+        fprintf(stderr, "fd limit %lu is below %d connections, raise ulimit "
+                        "-Hn\n",
+                static_cast<unsigned long>(rl.rlim_cur), numConns);
+    }
+
+    printf("%d connections, %zu byte message each\n", numConns, messageBytes);
+    runOnce("vector", kVector, numConns, messageBytes, port);
+    runOnce("vector+reclaim", kVectorReclaim, numConns, messageBytes, port);
+    runOnce("chained", kChained, numConns, messageBytes, port);
+    return 0;
+}
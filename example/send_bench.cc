@@ -0,0 +1,162 @@
+#include <mymuduo/Buffer.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/SharedSlice.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * 跨线程send的开销：业务线程（不是loop线程）构造消息后交给TcpConnection发送
+ * 对比四种重载：send(const string&)要拷贝一次，send(string&&)移动进回调，
+ * send(Buffer*)交换走缓冲区，send(SharedSlice)只增加引用计数
+ * 客户端在同一个进程里读完全部数据才算结束，统计业务线程每次send的耗时和端到端吞吐
+ * 用法：./send_bench [消息数] [消息字节数] [端口]
+ */
+enum Mode { kCopy, kMove, kBuffer, kSlice };
+
+static std::mutex g_mutex;
+static std::condition_variable g_cond;
+static TcpConnectionPtr g_conn;
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+static void produce(Mode mode, const TcpConnectionPtr &conn, int count,
+                    size_t messageBytes, double *elapsed) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        // 每条消息都是新构造的，和业务线程里序列化出一条响应相当
+        std::string message(messageBytes, static_cast<char>('a' + i % 26));
+        switch (mode) {
+        case kCopy:
+            conn->send(message);
+            break;
+        case kMove:
+            conn->send(std::move(message));
+            break;
+        case kBuffer: {
+            Buffer buf(messageBytes);
+            buf.append(message.data(), message.size());
+            conn->send(&buf);
+            break;
+        }
+        case kSlice:
+            conn->send(SharedSlice(std::move(message)));
+            break;
+        }
+    }
+    *elapsed = seconds(start);
+}
+
+static bool drain(int sockfd, size_t total) {
+    char buf[65536];
+    size_t received = 0;
+    while (received < total) {
+        ssize_t n = ::read(sockfd, buf, sizeof buf);
+        if (n <= 0) {
+            return false;
+        }
+        received += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void runClient(EventLoop *loop, uint16_t port, int count,
+                      size_t messageBytes) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) < 0) {
+        fprintf(stderr, "connect failed\n");
+        loop->quit();
+        return;
+    }
+
+    TcpConnectionPtr conn;
+    {
+        std::unique_lock<std::mutex> lock(g_mutex);
+        while (!g_conn) {
+            g_cond.wait(lock);
+        }
+        conn = g_conn;
+    }
+
+    struct Case {
+        const char *name;
+        Mode mode;
+    };
+    const Case kCases[] = {{"string copy", kCopy},
+                           {"string move", kMove},
+                           {"Buffer swap", kBuffer},
+                           {"SharedSlice", kSlice}};
+    const size_t total = static_cast<size_t>(count) * messageBytes;
+    printf("%-12s %14s %10s\n", "overload", "ns/send", "MB/s");
+    for (const Case &c : kCases) {
+        double produceSeconds = 0;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        std::thread producer(produce, c.mode, conn, count, messageBytes,
+                             &produceSeconds);
+        bool ok = drain(sockfd, total);
+        producer.join();
+        double elapsed = seconds(start);
+        if (!ok) {
+            fprintf(stderr, "connection closed during %s\n", c.name);
+            break;
+        }
+        printf("%-12s %14.0f %10.1f\n", c.name, produceSeconds * 1e9 / count,
+               total / elapsed / 1e6);
+    }
+
+    ::close(sockfd);
+    conn.reset();
+    loop->quit();
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 50000;
+    size_t messageBytes = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 4096;
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+    Logger::instance().setLogLevel(ERROR);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "SendBench");
+    // 连接在subLoop上，业务线程的send都要经过跨线程队列
+    server.setThreadNum(1);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_conn = conn->connected() ? conn : TcpConnectionPtr();
+        g_cond.notify_all();
+    });
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.start();
+
+    printf("%d messages of %zu bytes per overload\n", count, messageBytes);
+    std::thread client(runClient, &loop, port, count, messageBytes);
+    loop.loop();
+    client.join();
+    // 连接要在TcpServer和loop之前释放
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_conn.reset();
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * 通过loopback发送大文件的吞吐
+ * 对比sendFile（sendfile(2)，数据不经过用户态）和常见的写法：
+ * 每次pread 64KB到字符串里再send，writeCompleteCallback里读下一块
+ * 客户端在同一个进程里把数据读完才算结束，文件默认1GB，测试结束后删除
+ * 用法：./sendfile_bench [文件MB数] [文件路径] [端口]
+ */
+enum Mode { kSendFile, kReadSend };
+
+static const size_t kChunkSize = 64 * 1024;
+
+static std::atomic<int> g_mode(kSendFile);
+static int g_fd = -1;
+static size_t g_fileSize = 0;
+static size_t g_offset = 0; // kReadSend模式下一次要读的位置，只在loop线程访问
+
+static bool createFile(const char *path, size_t size) {
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    // 写真实的数据，稀疏文件读出来全是零页，不能代表真实的文件
+    std::string chunk(1024 * 1024, 'x');
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        chunk[i] = static_cast<char>('a' + i % 26);
+    }
+    size_t written = 0;
+    while (written < size) {
+        size_t n = std::min(chunk.size(), size - written);
+        if (::write(fd, chunk.data(), n) != static_cast<ssize_t>(n)) {
+            ::close(fd);
+            return false;
+        }
+        written += n;
+    }
+    ::close(fd);
+    return true;
+}
+
+static void sendNextChunk(const TcpConnectionPtr &conn) {
+    if (g_offset >= g_fileSize) {
+        return;
+    }
+    size_t n = std::min(kChunkSize, g_fileSize - g_offset);
+    std::string chunk(n, '\0');
+    ssize_t got = ::pread(g_fd, &chunk[0], n, static_cast<off_t>(g_offset));
+    if (got <= 0) {
+        conn->shutdown();
+        return;
+    }
+    chunk.resize(static_cast<size_t>(got));
+    g_offset += static_cast<size_t>(got);
+    conn->send(std::move(chunk));
+}
+
+static void onConnection(const TcpConnectionPtr &conn) {
+    if (!conn->connected()) {
+        return;
+    }
+    if (g_mode == kSendFile) {
+        conn->sendFile(g_fd, 0, g_fileSize);
+    } else {
+        g_offset = 0;
+        sendNextChunk(conn);
+    }
+}
+
+static void onWriteComplete(const TcpConnectionPtr &conn) {
+    if (g_mode == kReadSend) {
+        sendNextChunk(conn);
+    }
+}
+
+static double receive(uint16_t port, size_t total) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) < 0) {
+        ::close(sockfd);
+        return -1;
+    }
+    char buf[256 * 1024];
+    size_t received = 0;
+    while (received < total) {
+        ssize_t n = ::read(sockfd, buf, sizeof buf);
+        if (n <= 0) {
+            break;
+        }
+        received += static_cast<size_t>(n);
+    }
+    ::close(sockfd);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return received == total ? seconds : -1;
+}
+
+static void runClient(EventLoop *loop, uint16_t port) {
+    struct Case {
+        const char *name;
+        Mode mode;
+    };
+    const Case kCases[] = {{"sendFile", kSendFile},
+                           {"pread+send", kReadSend}};
+    for (const Case &c : kCases) {
+        g_mode = c.mode;
+        double seconds = receive(port, g_fileSize);
+        if (seconds < 0) {
+            printf("%-12s failed\n", c.name);
+            continue;
+        }
+        printf("%-12s %6.2f GB/s (%.2f s)\n", c.name,
+               g_fileSize / seconds / 1e9, seconds);
+    }
+    loop->quit();
+}
+
+int main(int argc, char *argv[]) {
+    size_t megabytes = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 1024;
+    const char *path = argc > 2 ? argv[2] : "sendfile_bench.dat";
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+    Logger::instance().setLogLevel(ERROR);
+
+    g_fileSize = megabytes * 1024 * 1024;
+    if (!createFile(path, g_fileSize)) {
+        fprintf(stderr, "cannot create %s\n", path);
+        return 1;
+    }
+    g_fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    // 先顺序读一遍，两种方式都从page cache里读
+    char warm[kChunkSize];
+    while (::read(g_fd, warm, sizeof warm) > 0) {
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "SendFileBench");
+    server.setThreadNum(1);
+    server.setConnectionCallback(onConnection);
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.setWrtteCompleteCallback(onWriteComplete);
+    server.start();
+
+    printf("%zu MB file over loopback\n", megabytes);
+    std::thread client(runClient, &loop, port);
+    loop.loop();
+    client.join();
+
+    ::close(g_fd);
+    ::unlink(path);
+    return 0;
+}
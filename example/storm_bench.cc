@@ -0,0 +1,150 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 连接风暴测试：同时发起大量非阻塞connect，统计服务器全部接入所用的时间
+ * 服务器在子进程里运行，连接建立后发一个字节，客户端读到这个字节算作接入成功，
+ * 读到EOF或RST算作被拒绝（服务器fd耗尽时Acceptor用idleFd_接受后立即关闭）
+ * 用法：./storm_bench [连接数] [服务器fd上限] [端口]
+ * 不给fd上限时不限制，给一个比连接数小的值可以观察fd耗尽时服务器的表现
+ */
+static void runServer(uint16_t port, long fdLimit) {
+    if (fdLimit > 0) {
+        struct rlimit rl;
+        ::getrlimit(RLIMIT_NOFILE, &rl);
+        rl.rlim_cur = static_cast<rlim_t>(fdLimit);
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    // fd耗尽时每次accept失败都会打日志，会淹没测试结果
+    Logger::instance().setLogLevel(FATAL);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "StormBench");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected()) {
+            conn->send("x");
+        }
+    });
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.start();
+    loop.loop();
+}
+
+static bool waitForServer(const sockaddr_in &addr) {
+    for (int i = 0; i < 100; ++i) {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int ret = ::connect(sockfd, (const sockaddr *)&addr, sizeof addr);
+        ::close(sockfd);
+        if (ret == 0) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    int numConns = argc > 1 ? atoi(argv[1]) : 5000;
+    long fdLimit = argc > 2 ? atol(argv[2]) : 0;
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9981);
+
+    pid_t child = ::fork();
+    if (child == 0) {
+        runServer(port, fdLimit);
+        return 0;
+    }
+
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (!waitForServer(addr)) {
+        fprintf(stderr, "server did not start\n");
+        ::kill(child, SIGKILL);
+        return 1;
+    }
+
+    // 客户端自己也要持有numConns个socket
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < static_cast<rlim_t>(numConns) + 64) {
+        rl.rlim_cur = std::min(rl.rlim_max, static_cast<rlim_t>(numConns) + 64);
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<int> fds;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numConns; ++i) {
+        int sockfd =
+            ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) {
+            fprintf(stderr, "client socket failed after %d: %s\n", i,
+                    strerror(errno));
+            break;
+        }
+        ::connect(sockfd, (const sockaddr *)&addr, sizeof addr);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = sockfd;
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev);
+        fds.push_back(sockfd);
+    }
+
+    // 每个连接只关心第一次可读：读到一个字节是接入成功，否则是被拒绝
+    int served = 0;
+    int rejected = 0;
+    int pending = static_cast<int>(fds.size());
+    std::vector<struct epoll_event> events(1024);
+    while (pending > 0) {
+        int n = ::epoll_wait(epfd, events.data(), static_cast<int>(events.size()),
+                             10000);
+        if (n <= 0) {
+            break; // 10秒没有任何进展
+        }
+        for (int i = 0; i < n; ++i) {
+            int sockfd = events[i].data.fd;
+            char c;
+            if (::read(sockfd, &c, 1) == 1) {
+                ++served;
+            } else {
+                ++rejected;
+            }
+            ::epoll_ctl(epfd, EPOLL_CTL_DEL, sockfd, nullptr);
+            --pending;
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    printf("connections %zu served %d rejected %d timeout %d\n", fds.size(),
+           served, rejected, pending);
+    printf("elapsed %.3f s, %.0f conn/s\n", seconds, served / seconds);
+
+    for (int sockfd : fds) {
+        ::close(sockfd);
+    }
+    ::close(epfd);
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+    return 0;
+}
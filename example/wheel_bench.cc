@@ -0,0 +1,133 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/TimerId.h>
+#include <mymuduo/TimingWheel.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 空闲检测的开销：100万个连接，每秒touch 10万次
+ * 对比时间轮（touch只改一个整数）和每个连接一个TimerQueue定时器（touch要cancel再runAfter）
+ * 统计建立条目的耗时、运行期间loop线程的CPU占用和内存增量
+ * 用法：./wheel_bench [连接数] [每秒touch数] [运行秒数]
+ */
+static const int kTimeoutTicks = 100;   // 超时100个tick
+static const double kTickSeconds = 0.1; // 也就是10秒，测试期间不会有连接超时
+static const double kTouchInterval = 0.01;
+
+static double threadCpuSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double wallSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long rssKb() {
+    long pages = 0;
+    long resident = 0;
+    FILE *fp = ::fopen("/proc/self/statm", "r");
+    if (fp != nullptr) {
+        if (::fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        ::fclose(fp);
+    }
+    return resident * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// 随机挑选被touch的连接
+static uint64_t g_random = 88172645463325252ULL;
+static size_t nextIndex(size_t n) {
+    g_random ^= g_random << 13;
+    g_random ^= g_random >> 7;
+    g_random ^= g_random << 17;
+    return static_cast<size_t>(g_random % n);
+}
+
+static void report(const char *name, double addSeconds, size_t conns,
+                   double cpuSeconds, double seconds, long rssBefore,
+                   long rssAfter, long expired) {
+    printf("%-12s add %6.0f ns/conn, loop cpu %5.1f%%, rss +%ld MB, expired "
+           "%ld\n",
+           name, addSeconds * 1e9 / conns, cpuSeconds * 100 / seconds,
+           (rssAfter - rssBefore) / 1024, expired);
+}
+
+static void runWheel(size_t conns, int touchesPerSecond, double seconds) {
+    EventLoop loop;
+    long rssBefore = rssKb();
+    long expired = 0;
+    // 时间轮析构时会把entries里的指针置空，entries要比时间轮活得久
+    std::vector<TimingWheel::Entry *> entries(conns);
+    TimingWheel wheel(&loop, 256, kTickSeconds);
+
+    double start = wallSeconds();
+    for (size_t i = 0; i < conns; ++i) {
+        wheel.add(kTimeoutTicks, [&expired]() { ++expired; }, &entries[i]);
+    }
+    double addSeconds = wallSeconds() - start;
+
+    int perRound = static_cast<int>(touchesPerSecond * kTouchInterval);
+    loop.runEvery(kTouchInterval, [&wheel, &entries, perRound]() {
+        for (int i = 0; i < perRound; ++i) {
+            wheel.touch(entries[nextIndex(entries.size())]);
+        }
+    });
+    loop.runAfter(seconds, [&loop]() { loop.quit(); });
+    double cpuStart = threadCpuSeconds();
+    loop.loop();
+    double cpu = threadCpuSeconds() - cpuStart;
+    report("TimingWheel", addSeconds, conns, cpu, seconds, rssBefore, rssKb(),
+           expired);
+}
+
+static void runTimerQueue(size_t conns, int touchesPerSecond, double seconds) {
+    EventLoop loop;
+    long rssBefore = rssKb();
+    long expired = 0;
+    const double timeout = kTimeoutTicks * kTickSeconds;
+    std::vector<TimerId> timers(conns);
+
+    double start = wallSeconds();
+    for (size_t i = 0; i < conns; ++i) {
+        timers[i] = loop.runAfter(timeout, [&expired]() { ++expired; });
+    }
+    double addSeconds = wallSeconds() - start;
+
+    int perRound = static_cast<int>(touchesPerSecond * kTouchInterval);
+    loop.runEvery(kTouchInterval, [&loop, &timers, &expired, perRound,
+                                   timeout]() {
+        for (int i = 0; i < perRound; ++i) {
+            size_t index = nextIndex(timers.size());
+            loop.cancel(timers[index]);
+            timers[index] = loop.runAfter(timeout, [&expired]() { ++expired; });
+        }
+    });
+    loop.runAfter(seconds, [&loop]() { loop.quit(); });
+    double cpuStart = threadCpuSeconds();
+    loop.loop();
+    double cpu = threadCpuSeconds() - cpuStart;
+    report("TimerQueue", addSeconds, conns, cpu, seconds, rssBefore, rssKb(),
+           expired);
+}
+
+int main(int argc, char *argv[]) {
+    size_t conns = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 1000000;
+    int touchesPerSecond = argc > 2 ? atoi(argv[2]) : 100000;
+    double seconds = argc > 3 ? atof(argv[3]) : 5.0;
+
+    printf("%zu connections, %d touches/s, %.1f s\n", conns, touchesPerSecond,
+           seconds);
+    runWheel(conns, touchesPerSecond, seconds);
+    runTimerQueue(conns, touchesPerSecond, seconds);
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/SharedSlice.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * MSG_ZEROCOPY发送的CPU开销，以及内核拷贝时的自动回退
+ * 服务器把同一份1MB的SharedSlice反复发给客户端，应用层没有任何拷贝，
+ * 统计服务器进程每发送1GB用掉的CPU，对比普通发送和零拷贝发送
+ * loopback上内核总是把零拷贝的数据再拷贝一次，完成通知带SO_EE_CODE_ZEROCOPY_COPIED，
+ * 连接收到第一个这样的通知后就退回普通发送，输出里零拷贝次数远小于发送次数
+ * 用法：./zerocopy_bench [MB数] [端口]
+ *       ./zerocopy_bench server <ip> <端口> [MB数]   只运行零拷贝服务器，
+ *       在另一台机器上用 nc <ip> <端口> > /dev/null 接收，测真实网卡上的CPU开销
+ */
+static const size_t kChunkSize = 1024 * 1024;
+static const int kChunksInFlight = 4;
+static const size_t kZeroCopyThreshold = 64 * 1024;
+
+static double cpuSeconds() {
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// 一个连接的发送进度，只在loop线程访问
+struct SendState {
+    size_t chunksSent;
+    size_t totalChunks;
+    double cpuStart;
+    bool reported; // 最后一块发完之后writeCompleteCallback可能不止一次
+};
+
+static void runServer(const InetAddress &addr, size_t megabytes,
+                      bool zeroCopy, bool once) {
+    Logger::instance().setLogLevel(ERROR);
+    EventLoop loop;
+    TcpServer server(&loop, addr, "ZeroCopyBench");
+    if (zeroCopy) {
+        server.setZeroCopyThreshold(kZeroCopyThreshold);
+    }
+
+    std::string pattern(kChunkSize, '\0');
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        pattern[i] = static_cast<char>('a' + i % 26);
+    }
+    const SharedSlice payload(std::move(pattern));
+    SendState state = {0, 0, 0, false};
+
+    auto sendMore = [&payload, &state](const TcpConnectionPtr &conn) {
+        for (int i = 0; i < kChunksInFlight &&
+                        state.chunksSent < state.totalChunks;
+             ++i) {
+            conn->send(payload);
+            ++state.chunksSent;
+        }
+    };
+    server.setConnectionCallback(
+        [&loop, &state, &sendMore, megabytes, zeroCopy,
+         once](const TcpConnectionPtr &conn) {
+            if (conn->connected()) {
+                state.chunksSent = 0;
+                state.totalChunks = megabytes;
+                state.cpuStart = cpuSeconds();
+                state.reported = false;
+                sendMore(conn);
+            } else if (once) {
+                loop.quit();
+            }
+        });
+    server.setWrtteCompleteCallback(
+        [&state, &sendMore, zeroCopy](const TcpConnectionPtr &conn) {
+            if (state.chunksSent < state.totalChunks) {
+                sendMore(conn);
+                return;
+            }
+            if (state.reported) {
+                return;
+            }
+            state.reported = true;
+            double cpu = cpuSeconds() - state.cpuStart;
+            double gigabytes = state.totalChunks * kChunkSize / 1e9;
+            printf("%-9s %8.1f ms cpu/GB, %6zu sends, %6llu zerocopy, %6llu "
+                   "copied%s\n",
+                   zeroCopy ? "zerocopy" : "copy", cpu * 1e3 / gigabytes,
+                   state.totalChunks,
+                   static_cast<unsigned long long>(conn->zeroCopySends()),
+                   static_cast<unsigned long long>(conn->zeroCopyCopied()),
+                   zeroCopy && conn->zeroCopyCopied() > 0
+                       ? " -> fell back to copying sends"
+                       : "");
+            fflush(stdout);
+            conn->shutdown();
+        });
+    server.setMessageCallback(
+        [](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.start();
+    loop.loop();
+}
+
+static bool receiveAll(uint16_t port, size_t total) {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < 100; ++i) {
+        int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(sockfd, (sockaddr *)&addr, sizeof addr) < 0) {
+            ::close(sockfd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+        char buf[256 * 1024];
+        size_t received = 0;
+        ssize_t n = 0;
+        while ((n = ::read(sockfd, buf, sizeof buf)) > 0) {
+            received += static_cast<size_t>(n);
+        }
+        ::close(sockfd);
+        return received == total;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "server") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "usage: %s server <ip> <port> [MB]\n", argv[0]);
+            return 1;
+        }
+        size_t megabytes = argc > 4 ? static_cast<size_t>(atol(argv[4])) : 1024;
+        runServer(InetAddress(static_cast<uint16_t>(atoi(argv[3])), argv[2]),
+                  megabytes, true, false);
+        return 0;
+    }
+
+    size_t megabytes = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 1024;
+    uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9981);
+    printf("%zu MB over loopback in %zu KB chunks\n", megabytes,
+           kChunkSize / 1024);
+    const bool kModes[] = {false, true};
+    for (bool zeroCopy : kModes) {
+        fflush(stdout);
+        pid_t child = ::fork();
+        if (child == 0) {
+            runServer(InetAddress(port), megabytes, zeroCopy, true);
+            _exit(0);
+        }
+        if (!receiveAll(port, megabytes * kChunkSize)) {
+            fprintf(stderr, "%s run did not deliver every byte\n",
+                    zeroCopy ? "zerocopy" : "copy");
+            ::kill(child, SIGKILL);
+        }
+        ::waitpid(child, nullptr, 0);
+    }
+    return 0;
+}